@@ -0,0 +1,214 @@
+#include <bits/c++20-format/charconv-bits.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <vector>
+
+// Benchmark of the decimal integer kernel in <bits/c++20-format/charconv-bits.h>
+// against the implementation it replaced, which is kept here for reference.
+
+namespace reference
+{
+	template<typename Value>
+	unsigned to_chars_len(Value value)
+	{
+		unsigned n = 1;
+		for (;;)
+		{
+			if (value < 10u) return n;
+			if (value < 100u) return n + 1;
+			if (value < 1000u) return n + 2;
+			if (value < 10000u) return n + 3;
+			value /= 10000u;
+			n += 4;
+		}
+	}
+
+	template<typename Value>
+	void to_chars_10_impl(char *first, unsigned len, Value value)
+	{
+		constexpr char digits[201] =
+			"0001020304050607080910111213141516171819"
+			"2021222324252627282930313233343536373839"
+			"4041424344454647484950515253545556575859"
+			"6061626364656667686970717273747576777879"
+			"8081828384858687888990919293949596979899";
+		unsigned pos = len - 1;
+		while (value >= 100)
+		{
+			auto const num = (value % 100) * 2;
+			value /= 100;
+			first[pos] = digits[num + 1];
+			first[pos - 1] = digits[num];
+			pos -= 2;
+		}
+		if (value >= 10)
+		{
+			auto const num = value * 2;
+			first[1] = digits[num + 1];
+			first[0] = digits[num];
+		}
+		else
+			first[0] = '0' + value;
+	}
+}
+
+namespace current
+{
+	using namespace std::CXX20_FORMAT_DECORATE_NAME(__detail);
+
+	template<typename Value>
+	unsigned to_chars_len(Value value)
+	{
+		return __to_chars_len(value);
+	}
+
+	template<typename Value>
+	void to_chars_10_impl(char *first, unsigned len, Value value)
+	{
+		__to_chars_10_impl(first, len, value);
+	}
+}
+
+namespace
+{
+	constexpr int repetitions = 25;
+	constexpr std::size_t count = 1'000'000;
+
+	// Values with a uniformly distributed number of significant bits
+	template<typename Value>
+	std::vector<Value> random_lengths(std::mt19937_64 &engine)
+	{
+		std::vector<Value> values(count);
+		for (auto &value : values)
+			value = Value(engine()) >> (engine() % (sizeof(Value) * 8));
+		return values;
+	}
+
+	// Values with exactly the given number of decimal digits
+	std::vector<std::uint64_t> fixed_length(std::mt19937_64 &engine, unsigned digits)
+	{
+		std::uint64_t low = 1;
+		for (unsigned i = 1; i < digits; ++i)
+			low *= 10;
+		const std::uint64_t high = digits == 20 ? UINT64_MAX : low * 10 - 1;
+		std::uniform_int_distribution<std::uint64_t> distribution(low, high);
+		std::vector<std::uint64_t> values(count);
+		for (auto &value : values)
+			value = distribution(engine);
+		return values;
+	}
+
+	// Consecutive values, like counters and IDs
+	std::vector<std::uint32_t> counters()
+	{
+		std::vector<std::uint32_t> values(count);
+		for (std::size_t i = 0; i < count; ++i)
+			values[i] = std::uint32_t(i);
+		return values;
+	}
+
+	// Returns the time of one run over all values, in seconds, and a checksum of the output
+	template<typename Kernel, typename Value>
+	double measure(const std::vector<Value> &values, unsigned long long &checksum)
+	{
+		char buffer[40];
+		unsigned long long sum = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (const auto value : values)
+		{
+			const unsigned len = Kernel::to_chars_len(value);
+			Kernel::to_chars_10_impl(buffer, len, value);
+			asm volatile("" : : "r"(buffer) : "memory");
+			sum += len + static_cast<unsigned char>(buffer[len - 1]);
+		}
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		checksum = sum;
+		return elapsed.count();
+	}
+
+	struct Reference
+	{
+		template<typename Value>
+		static unsigned to_chars_len(Value value) { return reference::to_chars_len(value); }
+		template<typename Value>
+		static void to_chars_10_impl(char *first, unsigned len, Value value) { reference::to_chars_10_impl(first, len, value); }
+	};
+
+	struct Current
+	{
+		template<typename Value>
+		static unsigned to_chars_len(Value value) { return current::to_chars_len(value); }
+		template<typename Value>
+		static void to_chars_10_impl(char *first, unsigned len, Value value) { current::to_chars_10_impl(first, len, value); }
+	};
+
+	template<typename Value>
+	bool run(std::string_view name, const std::vector<Value> &values)
+	{
+		unsigned long long reference_sum = 0;
+		unsigned long long current_sum = 0;
+		// Alternate between the implementations and keep the best time of
+		// each, so that both are measured under the same conditions.
+		double reference_time = 1e9;
+		double current_time = 1e9;
+		for (int run = 0; run < repetitions; ++run)
+		{
+			reference_time = std::min(reference_time, measure<Reference>(values, reference_sum));
+			current_time = std::min(current_time, measure<Current>(values, current_sum));
+		}
+		std::printf("%-32.*s %8.3fs %8.3fs %7.2fx\n", int(name.size()), name.data(),
+			reference_time, current_time, reference_time / current_time);
+		return reference_sum == current_sum;
+	}
+
+	// Checks the output of both implementations against each other
+	template<typename Value>
+	bool verify(const std::vector<Value> &values)
+	{
+		for (const auto value : values)
+		{
+			char expected[40];
+			char actual[40];
+			const unsigned expected_len = reference::to_chars_len(value);
+			const unsigned actual_len = current::to_chars_len(value);
+			reference::to_chars_10_impl(expected, expected_len, value);
+			current::to_chars_10_impl(actual, actual_len, value);
+			if (expected_len != actual_len || std::memcmp(expected, actual, expected_len) != 0)
+				return false;
+		}
+		return true;
+	}
+}
+
+int main()
+{
+	std::mt19937_64 engine(42);
+
+	const auto random_u32 = random_lengths<std::uint32_t>(engine);
+	const auto random_u64 = random_lengths<std::uint64_t>(engine);
+	const auto timestamps = fixed_length(engine, 10);
+	const auto long_values = fixed_length(engine, 20);
+	const auto ids = counters();
+
+	if (!verify(random_u32) || !verify(random_u64) || !verify(timestamps) || !verify(long_values) || !verify(ids))
+	{
+		std::puts("output differs from the reference implementation");
+		return 1;
+	}
+
+	std::printf("%-32s %9s %9s %8s\n", "", "reference", "current", "speedup");
+	bool consistent = true;
+	consistent &= run("random u32 (random lengths)", random_u32);
+	consistent &= run("random u64 (random lengths)", random_u64);
+	consistent &= run("timestamps (10 digits)", timestamps);
+	consistent &= run("20-digit values", long_values);
+	consistent &= run("counters", ids);
+
+	return consistent ? 0 : 1;
+}
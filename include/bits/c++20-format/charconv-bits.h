@@ -36,6 +36,7 @@
 
 #if __cplusplus >= 201103L
 
+#include <bit>
 #include <type_traits>
 #include <ext/numeric_traits.h>
 
@@ -61,6 +62,27 @@ namespace CXX20_FORMAT_DECORATE_NAME(__detail)
       static_assert(__integer_to_chars_is_unsigned<_Tp>, "implementation bug");
 #endif
 
+      if _GLIBCXX17_CONSTEXPR (__gnu_cxx::__int_traits<_Tp>::__digits <= 128)
+	if (__base == 10)
+	  {
+	    // The bit width gives an estimate that is one digit too large at
+	    // most, so a single comparison corrects it.
+	    constexpr unsigned long long __pow10[20] = {
+	      1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+	      10000000ull, 100000000ull, 1000000000ull, 10000000000ull,
+	      100000000000ull, 1000000000000ull, 10000000000000ull,
+	      100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+	      100000000000000000ull, 1000000000000000000ull,
+	      10000000000000000000ull
+	    };
+	    const _Tp __v = __value | 1;
+	    const unsigned __t = (std::__bit_width(__v) * 1233) >> 12;
+	    if _GLIBCXX17_CONSTEXPR (__gnu_cxx::__int_traits<_Tp>::__digits > 64)
+	      if (__t >= 19)
+		return __t + 1 - (__v < _Tp(__pow10[19]) * __pow10[__t - 19]);
+	    return __t + 1 - ((unsigned long long)__v < __pow10[__t]);
+	  }
+
       unsigned __n = 1;
       const unsigned __b2 = __base  * __base;
       const unsigned __b3 = __b2 * __base;
@@ -76,6 +98,92 @@ namespace CXX20_FORMAT_DECORATE_NAME(__detail)
 	}
     }
 
+  // The digits of 00 to 99. This is not local to __to_chars_10_2 because
+  // GCC copies a local table to the stack on every call.
+  inline constexpr char __to_chars_10_digits[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+  // Write the two digits of __val < 100 to [first,first+2).
+  constexpr void
+  __to_chars_10_2(char* __first, unsigned __val) noexcept
+  {
+    __first[0] = __to_chars_10_digits[__val * 2];
+    __first[1] = __to_chars_10_digits[__val * 2 + 1];
+  }
+
+  // Write the __len digits of a 32-bit value to [first,first+len), in
+  // constant evaluation, where __to_chars_10_8 cannot be used.
+  // The value is multiplied by 2^57 / 10^2m, rounded up, where 2m is the
+  // number of digits after the leading one or two. The top bits then hold
+  // the leading digits and the low 57 bits hold the rest as a fraction.
+  // Each multiplication of the fraction by 100 then moves the next two
+  // digits into the top bits. This is exact for all 32-bit values and
+  // needs no division.
+  constexpr void
+  __to_chars_10_32(char* __first, unsigned __len, unsigned __val) noexcept
+  {
+    if (__len <= 2)
+      {
+	if (__len == 2)
+	  __to_chars_10_2(__first, __val);
+	else
+	  __first[0] = '0' + __val;
+	return;
+      }
+
+    constexpr unsigned long long __inv[5] = {
+      0, 1441151880758559ull, 14411518807586ull, 144115188076ull,
+      1441151881ull
+    };
+    constexpr unsigned long long __mask = (1ull << 57) - 1;
+    const unsigned __m = (__len - 1) / 2;
+    unsigned long long __y = (unsigned long long)__val * __inv[__m];
+    if (__len & 1)
+      *__first++ = '0' + unsigned(__y >> 57);
+    else
+      {
+	__to_chars_10_2(__first, unsigned(__y >> 57));
+	__first += 2;
+      }
+    for (unsigned __i = 0; __i < __m; ++__i)
+      {
+	__y = (__y & __mask) * 100;
+	__to_chars_10_2(__first, unsigned(__y >> 57));
+	__first += 2;
+      }
+  }
+
+  // The eight decimal digits of __val < 10^8, with leading zeros, as the
+  // bytes of a word, the most significant digit first in memory. The value
+  // is split into two halves of four digits, the halves into pairs, and the
+  // pairs into digits, each step with one multiplication by a scaled
+  // reciprocal for all parts of the word at once. This is exact for all
+  // values below 10^8.
+  inline unsigned long long
+  __to_chars_10_8(unsigned __val) noexcept
+  {
+    constexpr unsigned long long __ones = 0x0101010101010101ull;
+    // __val / 10^4 in the low half and __val % 10^4 in the high half.
+    const unsigned long long __q4 = ((unsigned long long)__val * 109951163) >> 40;
+    unsigned long long __x = __q4 | (__val - __q4 * 10000) << 32;
+    // In each half, the first pair of digits in the low 16 bits and the
+    // second pair in the high 16 bits.
+    const unsigned long long __q2 = ((__x * 10486) >> 20) & 0x0000007f0000007full;
+    __x = __q2 | (__x - __q2 * 100) << 16;
+    // In each pair, the first digit in the low byte and the second digit
+    // in the high byte.
+    const unsigned long long __q1 = ((__x * 103) >> 10) & 0x000f000f000f000full;
+    __x = __q1 | (__x - __q1 * 10) << 8;
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    __x = __builtin_bswap64(__x);
+#endif
+    return __x + '0' * __ones;
+  }
+
   // Write an unsigned integer value to the range [first,first+len).
   // The caller is required to provide a buffer of exactly the right size
   // (which can be determined by the __to_chars_len function).
@@ -87,29 +195,195 @@ namespace CXX20_FORMAT_DECORATE_NAME(__detail)
       static_assert(__integer_to_chars_is_unsigned<_Tp>, "implementation bug");
 #endif
 
-      constexpr char __digits[201] =
-	"0001020304050607080910111213141516171819"
-	"2021222324252627282930313233343536373839"
-	"4041424344454647484950515253545556575859"
-	"6061626364656667686970717273747576777879"
-	"8081828384858687888990919293949596979899";
-      unsigned __pos = __len - 1;
-      while (__val >= 100)
+      // Split off 19 digits at a time until the rest fits in 64 bits, and
+      // write each part as a 64-bit value. That takes at most two divisions
+      // by 10^19, and they are done without 128-bit division: the high half
+      // is divided first, and then the remainder and the low half are
+      // divided using a precomputed reciprocal of 10^19, as described by
+      // Moller and Granlund, "Improved division by invariant integers".
+      if _GLIBCXX17_CONSTEXPR (__gnu_cxx::__int_traits<_Tp>::__digits > 64)
+	{
+	  constexpr unsigned long long __p19 = 10000000000000000000ull;
+	  // floor((2^128 - 1) / 10^19) - 2^64
+	  constexpr unsigned long long __inv = 0xd83c94fb6d2ac34aull;
+	  while (__len > 19)
+	    {
+	      const unsigned long long __hi = __val >> 64;
+	      const unsigned long long __lo = __val;
+	      const unsigned long long __q1 = __hi / __p19;
+	      const unsigned long long __u1 = __hi - __q1 * __p19;
+	      const _Tp __p = _Tp(__inv) * __u1 + (_Tp(__u1) << 64 | __lo);
+	      unsigned long long __q0 = (unsigned long long)(__p >> 64) + 1;
+	      unsigned long long __r = __lo - __q0 * __p19;
+	      if (__r > (unsigned long long)__p)
+		{
+		  --__q0;
+		  __r += __p19;
+		}
+	      if (__r >= __p19) [[__unlikely__]]
+		{
+		  ++__q0;
+		  __r -= __p19;
+		}
+	      __len -= 19;
+	      __to_chars_10_impl(__first + __len, 19, __r);
+	      __val = _Tp(__q1) << 64 | __q0;
+	    }
+	  __to_chars_10_impl(__first, __len, (unsigned long long)__val);
+	  return;
+	}
+
+      if (std::__is_constant_evaluated())
+	{
+	  if _GLIBCXX17_CONSTEXPR (__gnu_cxx::__int_traits<_Tp>::__digits > 32)
+	    while (__len > 9)
+	      {
+		const _Tp __quo = __val / 100000000u;
+		__len -= 8;
+		__to_chars_10_32(__first + __len, 8,
+				 unsigned(__val - __quo * 100000000u));
+		__val = __quo;
+	      }
+	  __to_chars_10_32(__first, __len, unsigned(__val));
+	  return;
+	}
+
+      // Write the last eight digits at a time, until at most eight are left.
+      // A 64-bit value is split into at most two such chunks and a head of
+      // four digits. The division by a constant compiles to a multiplication.
+      if _GLIBCXX17_CONSTEXPR (__gnu_cxx::__int_traits<_Tp>::__digits > 26)
+	while (__len > 8)
+	  {
+	    const _Tp __quo = __val / 100000000u;
+	    __len -= 8;
+	    const auto __x
+	      = __to_chars_10_8(unsigned(__val - __quo * 100000000u));
+	    __builtin_memcpy(__first + __len, &__x, 8);
+	    __val = __quo;
+	  }
+      // Convert the rest as eight digits too, and copy the last __len of
+      // them with two stores that overlap, instead of a loop that depends
+      // on the length. That has fewer branches to mispredict when the
+      // lengths vary.
+      const auto __x = __to_chars_10_8(unsigned(__val));
+      const char* __p = (const char*)&__x;
+      if (__len >= 4)
 	{
-	  auto const __num = (__val % 100) * 2;
-	  __val /= 100;
-	  __first[__pos] = __digits[__num + 1];
-	  __first[__pos - 1] = __digits[__num];
-	  __pos -= 2;
+	  __builtin_memcpy(__first, __p + 8 - __len, 4);
+	  __builtin_memcpy(__first + __len - 4, __p + 4, 4);
 	}
-      if (__val >= 10)
+      else if (__len >= 2)
 	{
-	  auto const __num = __val * 2;
-	  __first[1] = __digits[__num + 1];
-	  __first[0] = __digits[__num];
+	  __builtin_memcpy(__first, __p + 8 - __len, 2);
+	  __builtin_memcpy(__first + __len - 2, __p + 6, 2);
 	}
       else
-	__first[0] = '0' + __val;
+	__first[0] = __p[7];
+    }
+
+  // The eight hexadecimal digits of __val as the bytes of a word, the most
+  // significant digit first in memory. The nibbles are spread out to one
+  // per byte, and then each byte is turned into a digit in parallel.
+  inline unsigned long long
+  __to_chars_16_8(unsigned __val, bool __upper) noexcept
+  {
+    constexpr unsigned long long __ones = 0x0101010101010101ull;
+    unsigned long long __x = __val;
+    __x = (__x | __x << 16) & 0x0000ffff0000ffffull;
+    __x = (__x | __x << 8) & 0x00ff00ff00ff00ffull;
+    __x = (__x | __x << 4) & 0x0f0f0f0f0f0f0f0full;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    __x = __builtin_bswap64(__x);
+#endif
+    // One in each byte whose nibble is 10 or more.
+    const unsigned long long __alpha = ((__x + 6 * __ones) >> 4) & __ones;
+    return __x + '0' * __ones + __alpha * ((__upper ? 'A' : 'a') - '0' - 10);
+  }
+
+  // Write the hexadecimal digits of an unsigned integer value to the range
+  // [first,first+len), eight at a time. The caller is required to provide
+  // a buffer of exactly the right size.
+  template<typename _Tp>
+    _GLIBCXX23_CONSTEXPR void
+    __to_chars_16_impl(char* __first, unsigned __len, _Tp __val,
+		       bool __upper = false) noexcept
+    {
+#if __cpp_variable_templates
+      static_assert(__integer_to_chars_is_unsigned<_Tp>, "implementation bug");
+#endif
+
+      if (std::__is_constant_evaluated())
+	{
+	  const char* __digits
+	    = __upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	  while (__len)
+	    {
+	      __first[--__len] = __digits[__val & 0xf];
+	      __val >>= 4;
+	    }
+	  return;
+	}
+
+      if _GLIBCXX17_CONSTEXPR (__gnu_cxx::__int_traits<_Tp>::__digits > 32)
+	while (__len > 8)
+	  {
+	    __len -= 8;
+	    const auto __x = __to_chars_16_8(unsigned(__val), __upper);
+	    __builtin_memcpy(__first + __len, &__x, 8);
+	    __val >>= 32;
+	  }
+      const auto __x = __to_chars_16_8(unsigned(__val), __upper);
+      __builtin_memcpy(__first, (const char*)&__x + 8 - __len, __len);
+    }
+
+  // The eight binary digits of __byte as the bytes of a word, the most
+  // significant digit first in memory.
+  inline unsigned long long
+  __to_chars_2_8(unsigned __byte) noexcept
+  {
+    constexpr unsigned long long __ones = 0x0101010101010101ull;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    constexpr unsigned long long __bits = 0x0102040810204080ull;
+#else
+    constexpr unsigned long long __bits = 0x8040201008040201ull;
+#endif
+    // Keep a different bit of the byte in each byte of the word, and then
+    // turn each non-zero byte into one.
+    unsigned long long __x = (__byte * __ones) & __bits;
+    __x = ((__x + 0x7f * __ones) >> 7) & __ones;
+    return __x + '0' * __ones;
+  }
+
+  // Write the binary digits of an unsigned integer value to the range
+  // [first,first+len), eight at a time. The caller is required to provide
+  // a buffer of exactly the right size.
+  template<typename _Tp>
+    _GLIBCXX23_CONSTEXPR void
+    __to_chars_2_impl(char* __first, unsigned __len, _Tp __val) noexcept
+    {
+#if __cpp_variable_templates
+      static_assert(__integer_to_chars_is_unsigned<_Tp>, "implementation bug");
+#endif
+
+      if (std::__is_constant_evaluated())
+	{
+	  while (__len)
+	    {
+	      __first[--__len] = '0' + (__val & 1);
+	      __val >>= 1;
+	    }
+	  return;
+	}
+
+      while (__len > 8)
+	{
+	  __len -= 8;
+	  const auto __x = __to_chars_2_8(unsigned(__val & 0xff));
+	  __builtin_memcpy(__first + __len, &__x, 8);
+	  __val >>= 8;
+	}
+      const auto __x = __to_chars_2_8(unsigned(__val & 0xff));
+      __builtin_memcpy(__first, (const char*)&__x + 8 - __len, __len);
     }
 
 } // namespace __detail
@@ -176,30 +176,7 @@ namespace CXX20_FORMAT_DECORATE_NAME(__detail)
 	  return __res;
 	}
 
-      constexpr char __digits[] = {
-	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
-	'a', 'b', 'c', 'd', 'e', 'f'
-      };
-      unsigned __pos = __len - 1;
-      while (__val >= 0x100)
-	{
-	  auto __num = __val & 0xF;
-	  __val >>= 4;
-	  __first[__pos] = __digits[__num];
-	  __num = __val & 0xF;
-	  __val >>= 4;
-	  __first[__pos - 1] = __digits[__num];
-	  __pos -= 2;
-	}
-      if (__val >= 0x10)
-	{
-	  const auto __num = __val & 0xF;
-	  __val >>= 4;
-	  __first[1] = __digits[__num];
-	  __first[0] = __digits[__val];
-	}
-      else
-	__first[0] = __digits[__val];
+      CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_16_impl(__first, __len, __val);
       __res.ptr = __first + __len;
       __res.ec = {};
       return __res;
@@ -298,17 +275,7 @@ namespace CXX20_FORMAT_DECORATE_NAME(__detail)
 	  return __res;
 	}
 
-      unsigned __pos = __len - 1;
-
-      while (__pos)
-	{
-	  __first[__pos--] = '0' + (__val & 1);
-	  __val >>= 1;
-	}
-      // First digit is always '1' because __to_chars_len_2 skips
-      // leading zero bits and std::to_chars handles zero values
-      // directly.
-      __first[0] = '1';
+      CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_2_impl(__first, __len, __val);
 
       __res.ptr = __first + __len;
       __res.ec = {};
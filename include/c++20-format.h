@@ -32,19 +32,25 @@
 #if __cplusplus >= 202002L
 
 #include <array>
+#include <atomic>
 #include <bits/c++20-format/charconv.h>
 #include <concepts>
+#include <cstdio>
 #include <limits>
 #include <locale>
+#include <memory_resource>
 #include <optional>
+#include <ostream>
 #include <span>
 #include <string_view>
 #include <string>
 #include <variant>	       // monostate (TODO: move to bits/utility.h?)
+#include <vector>
 #include <bits/ranges_base.h>  // input_range, range_reference_t
 #include <bits/ranges_algobase.h> // ranges::copy
 #include <bits/stl_iterator.h> // back_insert_iterator
 #include <bits/stl_pair.h>     // __is_pair
+#include <bits/unique_ptr.h>    // unique_ptr
 #include <bits/utility.h>      // tuple_size_v
 #include <ext/numeric_traits.h> // __int_traits
 
@@ -72,6 +78,9 @@ inline namespace CXX20_FORMAT_NAMESPACE
   // [format.context], class template basic_format_context
   template<typename _Out, typename _CharT> class basic_format_context;
 
+  // Extension: space reserved in the output of a format context.
+  template<typename _CharT> class basic_format_reservation;
+
 /// @cond undocumented
 namespace CXX20_FORMAT_DECORATE_NAME(__format)
 {
@@ -80,6 +89,12 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
   // Output iterator that writes to a type-erase character sink.
   template<typename _CharT>
     class _Sink_iter;
+  // Replacement fields recorded when checking a format string.
+  template<typename _CharT, size_t _Nm>
+    struct _Field_store;
+  // Non-owning view of recorded replacement fields.
+  template<typename _CharT>
+    struct _Field_span;
 } // namespace __format
 /// @endcond
 
@@ -117,8 +132,22 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       get() const noexcept
       { return _M_str; }
 
+      // The replacement fields recorded by the compile-time check, so the
+      // string does not need to be scanned and parsed again at runtime.
+      [[__gnu__::__always_inline__]]
+      constexpr CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<_CharT>
+      _M_get_fields() const noexcept;
+
+      // An upper bound of the length of the output, see formatted_size_max.
+      [[__gnu__::__always_inline__]]
+      constexpr size_t
+      _M_get_max_size() const noexcept
+      { return _M_max_size; }
+
     private:
       basic_string_view<_CharT> _M_str;
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Field_store<_CharT, sizeof...(_Args)> _M_fields;
+      size_t _M_max_size;
     };
 
   template<typename... _Args>
@@ -128,6 +157,67 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     using wformat_string
       = basic_format_string<wchar_t, type_identity_t<_Args>...>;
 
+  template<typename _CharT> class basic_compiled_format;
+
+  using compiled_format = basic_compiled_format<char>;
+  using wcompiled_format = basic_compiled_format<wchar_t>;
+
+  template<typename... _Args>
+    compiled_format
+    make_compiled_format(string_view);
+
+  template<typename... _Args>
+    wcompiled_format
+    make_wcompiled_format(wstring_view);
+
+  /** A format string that was checked and parsed at runtime.
+   *
+   * This can be passed to `std::vformat` and `std::vformat_to` instead of
+   * a string, for format strings that are not known at compile-time but are
+   * used many times. The string is only scanned and its format-specs parsed
+   * once, by `std::make_compiled_format`. If it is used with arguments whose
+   * types might differ from the ones it was compiled for, it is scanned
+   * again and checked against the actual types instead.
+   *
+   * This is an extension.
+   */
+  template<typename _CharT>
+    class basic_compiled_format
+    {
+    public:
+      basic_compiled_format() = default;
+
+      [[__gnu__::__always_inline__]]
+      basic_string_view<_CharT>
+      get() const noexcept
+      { return _M_str; }
+
+      template<typename _Context>
+	[[__gnu__::__always_inline__]]
+	CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<_CharT>
+	_M_get_fields(const basic_format_args<_Context>& __args) const noexcept;
+
+    private:
+      template<typename... _Args>
+	static basic_compiled_format
+	_S_compile(basic_string_view<_CharT> __str);
+
+      template<typename... _Args>
+	friend compiled_format
+	make_compiled_format(string_view);
+
+      template<typename... _Args>
+	friend wcompiled_format
+	make_wcompiled_format(wstring_view);
+
+      basic_string<_CharT> _M_str;
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Field_store<_CharT, dynamic_extent> _M_fields;
+      // The number of arguments the fields were parsed for, and their types
+      // packed as by basic_format_args, or zero if they are not packed.
+      size_t _M_num_args = 0;
+      __UINT64_TYPE__ _M_arg_types = 0;
+    };
+
   // [format.formatter], formatter
 
   /// The primary template of std::formatter is disabled.
@@ -283,7 +373,8 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	  for (int __i = 0; __i < __n && (__first + __i) != __last; ++__i)
 	    __buf[__i] = __first[__i];
 	  auto [__v, __ptr] = CXX20_FORMAT_DECORATE_NAME(__format)::__parse_integer(__buf, __buf + __n);
-	  return {__v, __first + (__ptr - __buf)};
+	  if (__ptr) [[likely]]
+	    return {__v, __first + (__ptr - __buf)};
 	}
       return {0, nullptr};
     }
@@ -342,6 +433,16 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     _WP_from_arg // Use a formatting argument for width/prec.
   };
 
+  // Separators for grouping decimal digits in threes without a locale.
+  // As an extension, one of '_', '\'' or ',' can follow the width in the
+  // format-spec of an integer or floating-point type, as in "{:,d}".
+  enum _Group_sep {
+    _Group_none,
+    _Group_underscore, // '_'
+    _Group_apostrophe, // '\''
+    _Group_comma,      // ','
+  };
+
   template<typename _Context>
     size_t
     __int_from_arg(const basic_format_arg<_Context>& __arg);
@@ -352,6 +453,31 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
   constexpr bool __is_xdigit(char __c)
   { return std::CXX20_FORMAT_DECORATE_NAME(__detail)::__from_chars_alnum_to_val(__c) < 16; }
 
+  // Write the __n > 0 digits at __digits to __out with __sep between groups
+  // of three, counting from the right, and return the end of the output.
+  // This copies backwards, so __out can be __digits if there is room for
+  // (__n - 1) / 3 more characters after the digits.
+  inline char*
+  __group_by_three(const char* __digits, size_t __n, char* __out,
+		   char __sep) noexcept
+  {
+    char* const __end = __out + __n + (__n - 1) / 3;
+    char* __p = __end;
+    const char* __q = __digits + __n;
+    while (__q - __digits > 3)
+      {
+	__p -= 3;
+	__q -= 3;
+	__p[2] = __q[2];
+	__p[1] = __q[1];
+	__p[0] = __q[0];
+	*--__p = __sep;
+      }
+    while (__q != __digits)
+      *--__p = *--__q;
+    return __end;
+  }
+
   template<typename _CharT>
     struct _Spec
     {
@@ -363,6 +489,7 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       _WidthPrec _M_width_kind : 2;
       _WidthPrec _M_prec_kind : 2;
       _Pres_type _M_type : 4;
+      _Group_sep _M_group : 2;
       unsigned short _M_width;
       unsigned short _M_prec;
       _CharT _M_fill = ' ';
@@ -529,6 +656,40 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	return __next;
       }
 
+      // pre: __first != __last
+      constexpr iterator
+      _M_parse_grouping(iterator __first, iterator /* __last */) noexcept
+      {
+	switch (*__first)
+	{
+	  case '_':
+	    _M_group = _Group_underscore;
+	    return __first + 1;
+	  case '\'':
+	    _M_group = _Group_apostrophe;
+	    return __first + 1;
+	  case ',':
+	    _M_group = _Group_comma;
+	    return __first + 1;
+	  default:
+	    return __first;
+	}
+      }
+
+      constexpr char
+      _M_group_char() const noexcept
+      {
+	switch (_M_group)
+	{
+	  case _Group_underscore:
+	    return '_';
+	  case _Group_apostrophe:
+	    return '\'';
+	  default:
+	    return ',';
+	}
+      }
+
       // pre: __first != __last
       constexpr iterator
       _M_parse_locale(iterator __first, iterator /* __last */) noexcept
@@ -598,6 +759,23 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       return __out;
     }
 
+  // Write N copies of C to OUT (and do so efficiently if OUT is a _Sink_iter).
+  template<typename _Out, typename _CharT>
+    requires output_iterator<_Out, const _CharT&>
+    inline _Out
+    __write_fill(_Out __out, size_t __n, _CharT __c)
+    {
+      if constexpr (is_same_v<_Out, _Sink_iter<_CharT>>)
+	{
+	  if (__n)
+	    __out._M_write_fill(__n, __c);
+	}
+      else
+	for (; __n != 0; --__n)
+	  *__out++ = __c;
+      return __out;
+    }
+
   // Write STR to OUT with NFILL copies of FILL_CHAR specified by ALIGN.
   // pre: __align != _Align_default
   template<typename _Out, typename _CharT>
@@ -605,52 +783,26 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     __write_padded(_Out __out, basic_string_view<_CharT> __str,
 		   _Align __align, size_t __nfill, _CharT __fill_char)
     {
-      const size_t __buflen = 0x20;
-      _CharT __padding_chars[__buflen];
-      basic_string_view<_CharT> __padding{__padding_chars, __buflen};
-
-      auto __pad = [&__padding] (size_t __n, _Out& __o) {
-	if (__n == 0)
-	  return;
-	while (__n > __padding.size())
-	  {
-	    __o = CXX20_FORMAT_DECORATE_NAME(__format)::__write(std::move(__o), __padding);
-	    __n -= __padding.size();
-	  }
-	if (__n != 0)
-	  __o = CXX20_FORMAT_DECORATE_NAME(__format)::__write(std::move(__o), __padding.substr(0, __n));
-      };
-
-      size_t __l, __r, __max;
+      size_t __l, __r;
       if (__align == _Align_centre)
 	{
 	  __l = __nfill / 2;
 	  __r = __l + (__nfill & 1);
-	  __max = __r;
 	}
       else if (__align == _Align_right)
 	{
 	  __l = __nfill;
 	  __r = 0;
-	  __max = __l;
 	}
       else
 	{
 	  __l = 0;
 	  __r = __nfill;
-	  __max = __r;
 	}
-      if (__max < __buflen)
-	__padding.remove_suffix(__buflen - __max);
-      else
-	__max = __buflen;
-      char_traits<_CharT>::assign(__padding_chars, __max, __fill_char);
 
-      __pad(__l, __out);
+      __out = CXX20_FORMAT_DECORATE_NAME(__format)::__write_fill(std::move(__out), __l, __fill_char);
       __out = CXX20_FORMAT_DECORATE_NAME(__format)::__write(std::move(__out), __str);
-      __pad(__r, __out);
-
-      return __out;
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__write_fill(std::move(__out), __r, __fill_char);
     }
 
   // Write STR to OUT, with alignment and padding as determined by SPEC.
@@ -843,10 +995,17 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       { _M_spec._M_type = _Pres_esc; }
 #endif
 
-    private:
       _Spec<_CharT> _M_spec{};
     };
 
+  // The numeric punctuation of __loc. The library caches it in the locale
+  // the first time it is used, so later calls neither look up the numpunct
+  // facet's virtual functions nor copy its strings.
+  template<typename _CharT>
+    inline const __numpunct_cache<_CharT>&
+    __numpunct_of(const locale& __loc)
+    { return *std::__use_cache<__numpunct_cache<_CharT>>()(__loc); }
+
   template<__char _CharT>
     struct __formatter_int
     {
@@ -866,6 +1025,11 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	auto __first = __pc.begin();
 
 	auto __finalize = [this, &__spec] {
+	  if (__spec._M_group != _Group_none)
+	    if (__spec._M_type != _Pres_d || __spec._M_localized)
+	      __throw_format_error("format error: digit separators can only be "
+				   "used with decimal presentation types and "
+				   "without 'L'");
 	  _M_spec = __spec;
 	};
 
@@ -901,6 +1065,10 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	if (__finished())
 	  return __first;
 
+	__first = __spec._M_parse_grouping(__first, __last);
+	if (__finished())
+	  return __first;
+
 	__first = __spec._M_parse_locale(__first, __last);
 	if (__finished())
 	  return __first;
@@ -1000,68 +1168,25 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	  if (_M_spec._M_type == _Pres_c)
 	    return _M_format_character(_S_to_character(__i), __fc);
 
-	  char __buf[sizeof(_Int) * __CHAR_BIT__ + 3];
-	  CXX20_FORMAT_DECORATE_NAME(__to_chars_result) __res{};
-
-	  string_view __base_prefix;
-	  make_unsigned_t<_Int> __u;
-	  if (__i < 0)
-	    __u = -static_cast<make_unsigned_t<_Int>>(__i);
-	  else
-	    __u = __i;
-
-	  char* __start = __buf + 3;
-	  char* const __end = __buf + sizeof(__buf);
-	  char* const __start_digits = __start;
-
-	  switch (_M_spec._M_type)
-	  {
-	    case _Pres_b:
-	    case _Pres_B:
-	      __base_prefix = _M_spec._M_type == _Pres_b ? "0b" : "0B";
-	      __res = CXX20_FORMAT_DECORATE_NAME(__to_chars)(__start, __end, __u, 2);
-	      break;
-#if 0
-	    case _Pres_c:
-	      return _M_format_character(_S_to_character(__i), __fc);
-#endif
-	    case _Pres_none:
-	      // Should not reach here with _Pres_none for bool or charT, so:
-	      [[fallthrough]];
-	    case _Pres_d:
-	      __res = CXX20_FORMAT_DECORATE_NAME(__to_chars)(__start, __end, __u, 10);
-	      break;
-	    case _Pres_o:
-	      if (__i != 0)
-		__base_prefix = "0";
-	      __res = CXX20_FORMAT_DECORATE_NAME(__to_chars)(__start, __end, __u, 8);
-	      break;
-	    case _Pres_x:
-	    case _Pres_X:
-	      __base_prefix = _M_spec._M_type == _Pres_x ? "0x" : "0X";
-	      __res = CXX20_FORMAT_DECORATE_NAME(__to_chars)(__start, __end, __u, 16);
-	      if (_M_spec._M_type == _Pres_X)
-		for (auto __p = __start; __p != __res.ptr; ++__p)
-#if __has_builtin(__builtin_toupper)
-		  *__p = __builtin_toupper(*__p);
-#else
-		  *__p = std::toupper(*__p);
-#endif
-	      break;
-	    default:
-	      __builtin_unreachable();
-	  }
+	  constexpr size_t __buflen = sizeof(_Int) * __CHAR_BIT__ + 3;
+	  size_t __prefix_len;
 
-	  if (_M_spec._M_alt && __base_prefix.size())
-	    {
-	      __start -= __base_prefix.size();
-	      __builtin_memcpy(__start, __base_prefix.data(),
-			       __base_prefix.size());
-	    }
-	  __start = CXX20_FORMAT_DECORATE_NAME(__format)::__put_sign(__i, _M_spec._M_sign, __start - 1);
+	  // Without width or locale the characters can be written in place.
+	  if constexpr (is_same_v<_CharT, char>
+			  && is_same_v<_Out, _Sink_iter<_CharT>>)
+	    if (_M_spec._M_width_kind == _WP_none && !_M_spec._M_localized)
+	      {
+		const size_t __len = _M_int_chars_len(__i);
+		basic_format_reservation<_CharT> __r(__fc, __len);
+		_M_int_to_chars(__i, __r.data(), __len, __prefix_len);
+		__r.commit(__len);
+		return __fc.out();
+	      }
 
-	  return _M_format_int(string_view(__start, __res.ptr - __start),
-			       __start_digits - __start, __fc);
+	  char __buf[__buflen];
+	  char* __end = _M_int_to_chars(__i, __buf, __buflen, __prefix_len);
+	  return _M_format_int(string_view(__buf, __end - __buf),
+			       __prefix_len, __fc);
 	}
 
       template<typename _Out>
@@ -1073,12 +1198,15 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	  if (_M_spec._M_type != _Pres_s)
 	    return format(static_cast<unsigned char>(__i), __fc);
 
-	  basic_string<_CharT> __s;
+	  basic_string_view<_CharT> __s;
 	  size_t __est_width;
 	  if (_M_spec._M_localized) [[unlikely]]
 	    {
-	      auto& __np = std::use_facet<numpunct<_CharT>>(__fc.locale());
-	      __s = __i ? __np.truename() : __np.falsename();
+	      const auto& __nc = CXX20_FORMAT_DECORATE_NAME(__format)::__numpunct_of<_CharT>(__fc.locale());
+	      if (__i)
+		__s = {__nc._M_truename, __nc._M_truename_size};
+	      else
+		__s = {__nc._M_falsename, __nc._M_falsename_size};
 	      __est_width = __s.size(); // TODO Unicode-aware estimate
 	    }
 	  else
@@ -1123,6 +1251,138 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 			       "character");
 	}
 
+      // The number of characters _M_int_to_chars writes for __i.
+      template<typename _Int>
+	size_t
+	_M_int_chars_len(_Int __i) const noexcept
+	{
+	  make_unsigned_t<_Int> __u = __i;
+	  size_t __n = 0;
+	  if (__i < 0)
+	    {
+	      __u = -__u;
+	      __n = 1;
+	    }
+	  else if (_M_spec._M_sign == _Sign_plus
+		     || _M_spec._M_sign == _Sign_space)
+	    __n = 1;
+
+	  const unsigned __bits = __u ? std::__bit_width(__u) : 1;
+	  switch (_M_spec._M_type)
+	  {
+	    case _Pres_b:
+	    case _Pres_B:
+	      return __n + 2 * _M_spec._M_alt + __bits;
+	    case _Pres_o:
+	      return __n + (_M_spec._M_alt && __i != 0) + (__bits + 2) / 3;
+	    case _Pres_x:
+	    case _Pres_X:
+	      return __n + 2 * _M_spec._M_alt + (__bits + 3) / 4;
+	    default:
+	      {
+		using _Up = CXX20_FORMAT_DECORATE_NAME(__detail)::__unsigned_least_t<decltype(__u)>;
+		const unsigned __len = CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_len(_Up(__u));
+		if (_M_spec._M_group != _Group_none)
+		  __n += (__len - 1) / 3;
+		return __n + __len;
+	      }
+	  }
+	}
+
+      // Write the sign, base prefix and digits of __i to __dest, which must
+      // have room for __size characters, at least _M_int_chars_len(__i).
+      // Sets __prefix_len to the length of the sign and base prefix, and
+      // returns the end of the output.
+      template<typename _Int>
+	char*
+	_M_int_to_chars(_Int __i, char* __dest, size_t __size,
+			size_t& __prefix_len) const
+	{
+	  CXX20_FORMAT_DECORATE_NAME(__to_chars_result) __res{};
+
+	  make_unsigned_t<_Int> __u;
+	  if (__i < 0)
+	    __u = -static_cast<make_unsigned_t<_Int>>(__i);
+	  else
+	    __u = __i;
+
+	  char* __start = __dest;
+	  if (__i < 0)
+	    *__start++ = '-';
+	  else if (_M_spec._M_sign == _Sign_plus)
+	    *__start++ = '+';
+	  else if (_M_spec._M_sign == _Sign_space)
+	    *__start++ = ' ';
+
+	  if (_M_spec._M_alt)
+	    {
+	      string_view __base_prefix;
+	      switch (_M_spec._M_type)
+	      {
+		case _Pres_b:
+		  __base_prefix = "0b";
+		  break;
+		case _Pres_B:
+		  __base_prefix = "0B";
+		  break;
+		case _Pres_o:
+		  if (__i != 0)
+		    __base_prefix = "0";
+		  break;
+		case _Pres_x:
+		  __base_prefix = "0x";
+		  break;
+		case _Pres_X:
+		  __base_prefix = "0X";
+		  break;
+		default:
+		  break;
+	      }
+	      __start += __base_prefix.copy(__start, __base_prefix.size());
+	    }
+	  __prefix_len = __start - __dest;
+
+	  char* const __end = __dest + __size;
+
+	  using _Up = CXX20_FORMAT_DECORATE_NAME(__detail)::__unsigned_least_t<decltype(__u)>;
+	  switch (_M_spec._M_type)
+	  {
+	    case _Pres_b:
+	    case _Pres_B:
+	      {
+		const unsigned __len = __u ? std::__bit_width(__u) : 1;
+		CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_2_impl(__start, __len, _Up(__u));
+		__res.ptr = __start + __len;
+	      }
+	      break;
+	    case _Pres_none:
+	      // Should not reach here with _Pres_none for bool or charT, so:
+	      [[fallthrough]];
+	    case _Pres_d:
+	      __res = CXX20_FORMAT_DECORATE_NAME(__to_chars)(__start, __end, __u, 10);
+	      if (_M_spec._M_group != _Group_none)
+		__res.ptr = CXX20_FORMAT_DECORATE_NAME(__format)::__group_by_three(__start, __res.ptr - __start,
+						   __start,
+						   _M_spec._M_group_char());
+	      break;
+	    case _Pres_o:
+	      __res = CXX20_FORMAT_DECORATE_NAME(__to_chars)(__start, __end, __u, 8);
+	      break;
+	    case _Pres_x:
+	    case _Pres_X:
+	      {
+		const unsigned __len = __u ? (std::__bit_width(__u) + 3) / 4 : 1;
+		CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_16_impl(__start, __len, _Up(__u),
+						      _M_spec._M_type == _Pres_X);
+		__res.ptr = __start + __len;
+	      }
+	      break;
+	    default:
+	      __builtin_unreachable();
+	  }
+	  return __res.ptr;
+	}
+
       template<typename _Out>
 	typename basic_format_context<_Out, _CharT>::iterator
 	_M_format_int(string_view __narrow_str, size_t __prefix_len,
@@ -1149,27 +1409,21 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	    {
 	      if constexpr (is_same_v<char, _CharT>)
 		__loc = __fc.locale();
-	      const auto& __l = __loc.value();
-	      if (__l.name() != "C")
+	      const auto& __nc = CXX20_FORMAT_DECORATE_NAME(__format)::__numpunct_of<_CharT>(__loc.value());
+	      if (__nc._M_use_grouping)
 		{
-		  auto& __np = use_facet<numpunct<_CharT>>(__l);
-		  string __grp = __np.grouping();
-		  if (!__grp.empty())
-		    {
-		      size_t __n = __str.size() - __prefix_len;
-		      auto __p = (_CharT*)__builtin_alloca(2 * __n
-							     * sizeof(_CharT)
-							     + __prefix_len);
-		      auto __s = __str.data();
-		      char_traits<_CharT>::copy(__p, __s, __prefix_len);
-		      __s += __prefix_len;
-		      auto __end = std::__add_grouping(__p + __prefix_len,
-						       __np.thousands_sep(),
-						       __grp.data(),
-						       __grp.size(),
-						       __s, __s + __n);
-		      __str = {__p, size_t(__end - __p)};
-		    }
+		  size_t __n = __str.size() - __prefix_len;
+		  auto __p = (_CharT*)__builtin_alloca(2 * __n * sizeof(_CharT)
+							 + __prefix_len);
+		  auto __s = __str.data();
+		  char_traits<_CharT>::copy(__p, __s, __prefix_len);
+		  __s += __prefix_len;
+		  auto __end = std::__add_grouping(__p + __prefix_len,
+						   __nc._M_thousands_sep,
+						   __nc._M_grouping,
+						   __nc._M_grouping_size,
+						   __s, __s + __n);
+		  __str = {__p, size_t(__end - __p)};
 		}
 	    }
 
@@ -1322,6 +1576,12 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	auto __first = __pc.begin();
 
 	auto __finalize = [this, &__spec] {
+	  if (__spec._M_group != _Group_none)
+	    if (__spec._M_type == _Pres_a || __spec._M_type == _Pres_A
+		  || __spec._M_localized)
+	      __throw_format_error("format error: digit separators can only be "
+				   "used with decimal presentation types and "
+				   "without 'L'");
 	  _M_spec = __spec;
 	};
 
@@ -1360,6 +1620,10 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	      return __first;
 	  }
 
+	__first = __spec._M_parse_grouping(__first, __last);
+	if (__finished())
+	  return __first;
+
 	__first = __spec._M_parse_precision(__first, __last, __pc);
 	if (__finished())
 	  return __first;
@@ -1411,7 +1675,8 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	typename basic_format_context<_Out, _CharT>::iterator
 	format(_Fp __v, basic_format_context<_Out, _CharT>& __fc) const
 	{
-	  std::string __dynbuf;
+	  pmr::memory_resource* const __mr = __fc._M_resource();
+	  pmr::string __dynbuf(__mr);
 	  char __buf[128];
 	  CXX20_FORMAT_DECORATE_NAME(__to_chars_result) __res{};
 
@@ -1461,6 +1726,7 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	    case _Pres_none:
 	      if (__use_prec)
 		__fmt = CXX20_FORMAT_DECORATE_NAME(__chars_format)::general;
+	      __expc = 'e';
 	      break;
 	  }
 
@@ -1588,13 +1854,51 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 		}
 	    }
 
+	  // Group the digits of the integer part.
+	  pmr::string __grouped(__mr);
+	  if (_M_spec._M_group != _Group_none)
+	    {
+	      const char* const __s = __narrow_str.data();
+	      const size_t __n = __narrow_str.size();
+	      const size_t __b = !CXX20_FORMAT_DECORATE_NAME(__format)::__is_digit(__s[0]);
+	      size_t __e = __b;
+	      while (__e < __n && CXX20_FORMAT_DECORATE_NAME(__format)::__is_digit(__s[__e]))
+		++__e;
+	      if (const size_t __extras = __e - __b > 3 ? (__e - __b - 1) / 3 : 0)
+		{
+		  char* __p;
+		  if (__s == __start && __extras <= size_t(__end - __s - __n))
+		    {
+		      // Move the rest to make space for the separators.
+		      __p = const_cast<char*>(__s);
+		      __builtin_memmove(__p + __e + __extras, __p + __e,
+					__n - __e);
+		    }
+		  else
+		    {
+		      auto __copy = [__s, __n, __e, __extras](char* __d, size_t)
+		      {
+			__builtin_memcpy(__d, __s, __e);
+			__builtin_memcpy(__d + __e + __extras, __s + __e,
+					 __n - __e);
+			return __n + __extras;
+		      };
+		      _S_resize_and_overwrite(__grouped, __n + __extras, __copy);
+		      __p = __grouped.data();
+		    }
+		  CXX20_FORMAT_DECORATE_NAME(__format)::__group_by_three(__p + __b, __e - __b, __p + __b,
+						  _M_spec._M_group_char());
+		  __narrow_str = {__p, __n + __extras};
+		}
+	    }
+
 	  // TODO move everything below to a new member function that
 	  // doesn't depend on _Fp type.
 
 
 	  _Optional_locale __loc;
 	  basic_string_view<_CharT> __str;
-	  basic_string<_CharT> __wstr;
+	  pmr::basic_string<_CharT> __wstr(__mr);
 	  if constexpr (is_same_v<_CharT, char>)
 	    __str = __narrow_str;
 	  else
@@ -1611,13 +1915,17 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	      __str = __wstr;
 	    }
 
-	  if (_M_spec._M_localized)
+	  _CharT __lbuf[2 * sizeof(__buf)];
+	  pmr::basic_string<_CharT> __lstr(__mr);
+	  if (_M_spec._M_localized && __builtin_isfinite(__v))
 	    {
+	      basic_string_view<_CharT> __l;
 	      if constexpr (is_same_v<char, _CharT>)
-		__wstr = _M_localize(__str, __expc, __fc.locale());
+		__l = _M_localize(__str, __expc, __fc.locale(), __lbuf, __lstr);
 	      else
-		__wstr = _M_localize(__str, __expc, __loc.value());
-	      __str = __wstr;
+		__l = _M_localize(__str, __expc, __loc.value(), __lbuf, __lstr);
+	      if (!__l.empty())
+		__str = __l;
 	    }
 
 	  size_t __width = _M_spec._M_get_width(__fc);
@@ -1650,19 +1958,17 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 					  __align, __nfill, __fill_char);
 	}
 
-      // Locale-specific format.
-      basic_string<_CharT>
+      // Locale-specific format. Returns __str with the locale's radix point
+      // and digit grouping, written to __lbuf if it fits, or else to __lstr.
+      // Returns an empty view if the locale uses '.' and no grouping, and so
+      // __str needs no changes.
+      basic_string_view<_CharT>
       _M_localize(basic_string_view<_CharT> __str, char __expc,
-		  const locale& __loc) const
+		  const locale& __loc, span<_CharT> __lbuf,
+		  pmr::basic_string<_CharT>& __lstr) const
       {
-	basic_string<_CharT> __lstr;
-
-	if (__loc == locale::classic())
-	  return __lstr; // Nothing to do.
-
-	const auto& __np = use_facet<numpunct<_CharT>>(__loc);
-	const _CharT __point = __np.decimal_point();
-	const string __grp = __np.grouping();
+	const auto& __nc = CXX20_FORMAT_DECORATE_NAME(__format)::__numpunct_of<_CharT>(__loc);
+	const _CharT __point = __nc._M_decimal_point;
 
 	_CharT __dot, __exp;
 	if constexpr (is_same_v<_CharT, char>)
@@ -1677,8 +1983,8 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	    __exp = __ct.widen(__expc);
 	  }
 
-	if (__grp.empty() && __point == __dot)
-	  return __lstr; // Locale uses '.' and no grouping.
+	if (!__nc._M_use_grouping && __point == __dot)
+	  return {}; // Locale uses '.' and no grouping.
 
 	size_t __d = __str.find(__dot);
 	size_t __e = min(__d, __str.find(__exp));
@@ -1686,9 +1992,23 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	  __e = __str.size();
 	const size_t __r = __str.size() - __e;
 	auto __overwrite = [&](_CharT* __p, size_t) {
-	  auto __end = std::__add_grouping(__p, __np.thousands_sep(),
-					   __grp.data(), __grp.size(),
-					   __str.data(), __str.data() + __e);
+	  // Group the digits before the radix point or exponent, after any sign.
+	  size_t __off = 0;
+	  if (__e != 0)
+	    if (auto __c = __str.front(); __c == '-' || __c == '+' || __c == ' ')
+	      {
+		*__p = __c;
+		__off = 1;
+	      }
+	  _CharT* __end;
+	  if (__nc._M_use_grouping)
+	    __end = std::__add_grouping(__p + __off, __nc._M_thousands_sep,
+					__nc._M_grouping,
+					__nc._M_grouping_size,
+					__str.data() + __off,
+					__str.data() + __e);
+	  else
+	    __end = __p + __str.copy(__p, __e);
 	  if (__r)
 	    {
 	      if (__d != __str.npos)
@@ -1702,13 +2022,17 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	    }
 	  return (__end - __p);
 	};
-	_S_resize_and_overwrite(__lstr, __e * 2 + __r, __overwrite);
+	const size_t __n = __e * 2 + __r;
+	if (__n <= __lbuf.size())
+	  return {__lbuf.data(), size_t(__overwrite(__lbuf.data(), __n))};
+	_S_resize_and_overwrite(__lstr, __n, __overwrite);
 	return __lstr;
       }
 
-      template<typename _Ch, typename _Func>
+      template<typename _Ch, typename _Tr, typename _Al, typename _Func>
 	static void
-	_S_resize_and_overwrite(basic_string<_Ch>& __str, size_t __n, _Func __f)
+	_S_resize_and_overwrite(basic_string<_Ch, _Tr, _Al>& __str, size_t __n,
+				_Func __f)
 	{
 #if __cpp_lib_string_resize_and_overwrite
 	  __str.resize_and_overwrite(__n, __f);
@@ -1721,41 +2045,187 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       _Spec<_CharT> _M_spec{};
     };
 
-} // namespace __format
-/// @endcond
+// _GLIBCXX_RESOLVE_LIB_DEFECTS
+// P2510R3 Formatting pointers
+#define CXX20_P2518R3 (__cplusplus > 202302L || ! defined __STRICT_ANSI__)
 
-  // Format a character.
-  template<CXX20_FORMAT_DECORATE_NAME(__format)::__char _CharT>
-    struct formatter<_CharT, _CharT>
+  template<__char _CharT>
+    struct __formatter_ptr
     {
-      formatter() = default;
-
       constexpr typename basic_format_parse_context<_CharT>::iterator
       parse(basic_format_parse_context<_CharT>& __pc)
       {
-	return _M_f.template _M_parse<_CharT>(__pc);
-      }
+	_Spec<_CharT> __spec{};
+	const auto __last = __pc.end();
+	auto __first = __pc.begin();
 
-      template<typename _Out>
-	typename basic_format_context<_Out, _CharT>::iterator
-	format(_CharT __u, basic_format_context<_Out, _CharT>& __fc) const
-	{
-	  if (_M_f._M_spec._M_type == CXX20_FORMAT_DECORATE_NAME(__format)::_Pres_none)
-	    return _M_f._M_format_character(__u, __fc);
-	  else if (_M_f._M_spec._M_type == CXX20_FORMAT_DECORATE_NAME(__format)::_Pres_esc)
+	auto __finalize = [this, &__spec] {
+	  _M_spec = __spec;
+	};
+
+	auto __finished = [&] {
+	  if (__first == __last || *__first == '}')
 	    {
-	      // TODO
-	      return __fc.out();
+	      __finalize();
+	      return true;
 	    }
-	  else
-	    return _M_f.format(__u, __fc);
-	}
-
-#if __cpp_lib_format_ranges
-      constexpr void
-      set_debug_format() noexcept
-      { _M_f._M_spec._M_type = CXX20_FORMAT_DECORATE_NAME(__format)::_Pres_esc; }
-#endif
+	  return false;
+	};
+
+	if (__finished())
+	  return __first;
+
+	__first = __spec._M_parse_fill_and_align(__first, __last);
+	if (__finished())
+	  return __first;
+
+#if CXX20_P2518R3
+	__first = __spec._M_parse_zero_fill(__first, __last);
+	if (__finished())
+	  return __first;
+#endif
+
+	__first = __spec._M_parse_width(__first, __last, __pc);
+
+	if (__first != __last)
+	  {
+	    if (*__first == 'p')
+	      ++__first;
+#if CXX20_P2518R3
+	    else if (*__first == 'P')
+	    {
+	      // _GLIBCXX_RESOLVE_LIB_DEFECTS
+	      // P2510R3 Formatting pointers
+	      __spec._M_type = _Pres_P;
+	      ++__first;
+	    }
+#endif
+	  }
+
+	if (__finished())
+	  return __first;
+
+	CXX20_FORMAT_DECORATE_NAME(__format)::__failed_to_parse_format_spec();
+      }
+
+      template<typename _Out>
+	typename basic_format_context<_Out, _CharT>::iterator
+	format(const void* __v, basic_format_context<_Out, _CharT>& __fc) const
+	{
+	  constexpr size_t __buflen = 2 + sizeof(__v) * 2;
+
+	  // Without width the characters can be written in place.
+	  if constexpr (is_same_v<_CharT, char>
+			  && is_same_v<_Out, _Sink_iter<_CharT>>)
+	    if (_M_spec._M_width_kind == _WP_none)
+	      {
+		basic_format_reservation<_CharT> __r(__fc, _S_chars_len(__v));
+		__r.commit(_M_to_chars(__v, __r.data()));
+		return __fc.out();
+	      }
+
+	  char __buf[__buflen];
+	  const int __n = _M_to_chars(__v, __buf);
+
+	  basic_string_view<_CharT> __str;
+	  if constexpr (is_same_v<_CharT, char>)
+	    __str = string_view(__buf, __n);
+	  else
+	    {
+	      const std::locale& __loc = __fc.locale();
+	      auto& __ct = use_facet<ctype<_CharT>>(__loc);
+	      auto __p = (_CharT*)__builtin_alloca(__n * sizeof(_CharT));
+	      __ct.widen(__buf, __buf + __n, __p);
+	      __str = wstring_view(__p, __n);
+	    }
+
+#if CXX20_P2518R3
+	  if (_M_spec._M_zero_fill)
+	    {
+	      size_t __width = _M_spec._M_get_width(__fc);
+	      if (__width <= __str.size())
+		return CXX20_FORMAT_DECORATE_NAME(__format)::__write(__fc.out(), __str);
+
+	      auto __out = __fc.out();
+	      // Write "0x" or "0X" prefix before zero-filling.
+	      __out = CXX20_FORMAT_DECORATE_NAME(__format)::__write(std::move(__out), __str.substr(0, 2));
+	      __str.remove_prefix(2);
+	      size_t __nfill = __width - __n;
+	      return CXX20_FORMAT_DECORATE_NAME(__format)::__write_padded(std::move(__out), __str,
+					      _Align_right,
+					      __nfill, _CharT('0'));
+	    }
+#endif
+
+	  return CXX20_FORMAT_DECORATE_NAME(__format)::__write_padded_as_spec(__str, __n, __fc, _M_spec,
+						  _Align_right);
+	}
+
+    private:
+      // The number of characters _M_to_chars writes for __v.
+      static unsigned
+      _S_chars_len(const void* __v) noexcept
+      {
+	auto __u = reinterpret_cast<__UINTPTR_TYPE__>(__v);
+	return 2 + (__u ? (std::__bit_width(__u) + 3) / 4 : 1);
+      }
+
+      // Write "0x" or "0X" and the hex digits of __v to __dest, which must
+      // have room for _S_chars_len(__v) characters. Returns the length.
+      int
+      _M_to_chars(const void* __v, char* __dest) const
+      {
+	auto __u = reinterpret_cast<__UINTPTR_TYPE__>(__v);
+	const unsigned __len = _S_chars_len(__v) - 2;
+	bool __upper = false;
+#if CXX20_P2518R3
+	__upper = _M_spec._M_type == _Pres_P;
+#endif
+	__dest[0] = '0';
+	__dest[1] = __upper ? 'X' : 'x';
+	CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_16_impl(__dest + 2, __len, __u, __upper);
+	return 2 + __len;
+      }
+
+    public:
+      _Spec<_CharT> _M_spec{};
+    };
+
+} // namespace __format
+/// @endcond
+
+  // Format a character.
+  template<CXX20_FORMAT_DECORATE_NAME(__format)::__char _CharT>
+    struct formatter<_CharT, _CharT>
+    {
+      formatter() = default;
+
+      constexpr typename basic_format_parse_context<_CharT>::iterator
+      parse(basic_format_parse_context<_CharT>& __pc)
+      {
+	return _M_f.template _M_parse<_CharT>(__pc);
+      }
+
+      template<typename _Out>
+	typename basic_format_context<_Out, _CharT>::iterator
+	format(_CharT __u, basic_format_context<_Out, _CharT>& __fc) const
+	{
+	  if (_M_f._M_spec._M_type == CXX20_FORMAT_DECORATE_NAME(__format)::_Pres_none)
+	    return _M_f._M_format_character(__u, __fc);
+	  else if (_M_f._M_spec._M_type == CXX20_FORMAT_DECORATE_NAME(__format)::_Pres_esc)
+	    {
+	      // TODO
+	      return __fc.out();
+	    }
+	  else
+	    return _M_f.format(__u, __fc);
+	}
+
+#if __cpp_lib_format_ranges
+      constexpr void
+      set_debug_format() noexcept
+      { _M_f._M_spec._M_type = CXX20_FORMAT_DECORATE_NAME(__format)::_Pres_esc; }
+#endif
 
     private:
       CXX20_FORMAT_DECORATE_NAME(__format)::__formatter_int<_CharT> _M_f;
@@ -2038,126 +2508,18 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     {
       formatter() = default;
 
+      [[__gnu__::__always_inline__]]
       constexpr typename basic_format_parse_context<_CharT>::iterator
       parse(basic_format_parse_context<_CharT>& __pc)
-      {
-	CXX20_FORMAT_DECORATE_NAME(__format)::_Spec<_CharT> __spec{};
-	const auto __last = __pc.end();
-	auto __first = __pc.begin();
-
-	auto __finalize = [this, &__spec] {
-	  _M_spec = __spec;
-	};
-
-	auto __finished = [&] {
-	  if (__first == __last || *__first == '}')
-	    {
-	      __finalize();
-	      return true;
-	    }
-	  return false;
-	};
-
-	if (__finished())
-	  return __first;
-
-	__first = __spec._M_parse_fill_and_align(__first, __last);
-	if (__finished())
-	  return __first;
-
-// _GLIBCXX_RESOLVE_LIB_DEFECTS
-// P2510R3 Formatting pointers
-#define CXX20_P2518R3 (__cplusplus > 202302L || ! defined __STRICT_ANSI__)
-
-#if CXX20_P2518R3
-	__first = __spec._M_parse_zero_fill(__first, __last);
-	if (__finished())
-	  return __first;
-#endif
-
-	__first = __spec._M_parse_width(__first, __last, __pc);
-
-	if (__first != __last)
-	  {
-	    if (*__first == 'p')
-	      ++__first;
-#if CXX20_P2518R3
-	    else if (*__first == 'P')
-	    {
-	      // _GLIBCXX_RESOLVE_LIB_DEFECTS
-	      // P2510R3 Formatting pointers
-	      __spec._M_type = CXX20_FORMAT_DECORATE_NAME(__format)::_Pres_P;
-	      ++__first;
-	    }
-#endif
-	  }
-
-	if (__finished())
-	  return __first;
-
-	CXX20_FORMAT_DECORATE_NAME(__format)::__failed_to_parse_format_spec();
-      }
+      { return _M_f.parse(__pc); }
 
       template<typename _Out>
 	typename basic_format_context<_Out, _CharT>::iterator
 	format(const void* __v, basic_format_context<_Out, _CharT>& __fc) const
-	{
-	  auto __u = reinterpret_cast<__UINTPTR_TYPE__>(__v);
-	  char __buf[2 + sizeof(__v) * 2];
-	  auto [__ptr, __ec] = std::CXX20_FORMAT_NAMESPACE::CXX20_FORMAT_DECORATE_NAME(__to_chars)(__buf + 2, std::end(__buf),
-					     __u, 16);
-	  int __n = __ptr - __buf;
-	  __buf[0] = '0';
-	  __buf[1] = 'x';
-#if CXX20_P2518R3
-	  if (_M_spec._M_type == CXX20_FORMAT_DECORATE_NAME(__format)::_Pres_P)
-	    {
-	      __buf[1] = 'X';
-	      for (auto __p = __buf + 2; __p != __ptr; ++__p)
-#if __has_builtin(__builtin_toupper)
-		*__p = __builtin_toupper(*__p);
-#else
-		*__p = std::toupper(*__p);
-#endif
-	    }
-#endif
-
-	  basic_string_view<_CharT> __str;
-	  if constexpr (is_same_v<_CharT, char>)
-	    __str = string_view(__buf, __n);
-	  else
-	    {
-	      const std::locale& __loc = __fc.locale();
-	      auto& __ct = use_facet<ctype<_CharT>>(__loc);
-	      auto __p = (_CharT*)__builtin_alloca(__n * sizeof(_CharT));
-	      __ct.widen(__buf, __buf + __n, __p);
-	      __str = wstring_view(__p, __n);
-	    }
-
-#if CXX20_P2518R3
-	  if (_M_spec._M_zero_fill)
-	    {
-	      size_t __width = _M_spec._M_get_width(__fc);
-	      if (__width <= __str.size())
-		return CXX20_FORMAT_DECORATE_NAME(__format)::__write(__fc.out(), __str);
-
-	      auto __out = __fc.out();
-	      // Write "0x" or "0X" prefix before zero-filling.
-	      __out = CXX20_FORMAT_DECORATE_NAME(__format)::__write(std::move(__out), __str.substr(0, 2));
-	      __str.remove_prefix(2);
-	      size_t __nfill = __width - __n;
-	      return CXX20_FORMAT_DECORATE_NAME(__format)::__write_padded(std::move(__out), __str,
-					      CXX20_FORMAT_DECORATE_NAME(__format)::_Align_right,
-					      __nfill, _CharT('0'));
-	    }
-#endif
-
-	  return CXX20_FORMAT_DECORATE_NAME(__format)::__write_padded_as_spec(__str, __n, __fc, _M_spec,
-						  CXX20_FORMAT_DECORATE_NAME(__format)::_Align_right);
-	}
+	{ return _M_f.format(__v, __fc); }
 
     private:
-      CXX20_FORMAT_DECORATE_NAME(__format)::_Spec<_CharT> _M_spec{};
+      CXX20_FORMAT_DECORATE_NAME(__format)::__formatter_ptr<_CharT> _M_f;
     };
 
   template<CXX20_FORMAT_DECORATE_NAME(__format)::__char _CharT>
@@ -2271,6 +2633,15 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       iter_difference_t<_Out> size;
     };
 
+  /// An iterator after the last character written by format_to_n_truncated,
+  /// and whether the output did not fit.
+  template<typename _Out>
+    struct format_to_n_truncated_result
+    {
+      _Out out;
+      bool truncated;
+    };
+
 /// @cond undocumented
 namespace CXX20_FORMAT_DECORATE_NAME(__format)
 {
@@ -2321,6 +2692,29 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       [[__gnu__::__always_inline__]]
       constexpr _Sink_iter
       operator++(int) { return *this; }
+
+      // Write __n copies of __c.
+      [[__gnu__::__always_inline__]]
+      constexpr void
+      _M_write_fill(size_t __n, _CharT __c)
+      { _M_sink->_M_write_fill(__n, __c); }
+
+      // See _Sink::_M_reserve and _Sink::_M_bump.
+      [[__gnu__::__always_inline__]]
+      _CharT*
+      _M_reserve(size_t __n) const noexcept
+      { return _M_sink->_M_reserve(__n); }
+
+      [[__gnu__::__always_inline__]]
+      void
+      _M_bump(size_t __n) const
+      { _M_sink->_M_bump(__n); }
+
+      // True if the sink discards all further output.
+      [[__gnu__::__always_inline__]]
+      constexpr bool
+      _M_discarding() const noexcept
+      { return _M_sink->_M_discarding; }
     };
 
   // Abstract base class for type-erased character sinks.
@@ -2340,6 +2734,10 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       virtual void _M_overflow() = 0;
 
     protected:
+      // Set by sinks that discard all further output, so that formatting
+      // can stop early.
+      bool _M_discarding = false;
+
       // Precondition: __span.size() != 0
       [[__gnu__::__always_inline__]]
       explicit constexpr
@@ -2374,17 +2772,12 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	_M_next = __next;
       }
 
-      // Called by the iterator for *it++ = c
-      constexpr void
-      _M_write(_CharT __c)
-      {
-	*_M_next++ = __c;
-	if (_M_next - _M_span.begin() == std::ssize(_M_span)) [[unlikely]]
-	  _M_overflow();
-      }
-
-      constexpr void
-      _M_write(basic_string_view<_CharT> __s)
+      // Called by _M_write(__s) when __s does not fit into the unused part
+      // of the span. Copies as much as fits and calls _M_overflow() until
+      // all of __s is written. Sinks that can use the characters where they
+      // are, without copying them, can override this.
+      virtual void
+      _M_write_overflowing(basic_string_view<_CharT> __s)
       {
 	span __to = _M_unused();
 	while (__to.size() <= __s.size())
@@ -2393,6 +2786,8 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	    _M_next += __to.size();
 	    __s.remove_prefix(__to.size());
 	    _M_overflow();
+	    if (_M_discarding) [[unlikely]]
+	      return;
 	    __to = _M_unused();
 	  }
 	if (__s.size())
@@ -2402,12 +2797,73 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	  }
       }
 
-    public:
-      _Sink(const _Sink&) = delete;
-      _Sink& operator=(const _Sink&) = delete;
-
-      [[__gnu__::__always_inline__]]
-      constexpr _Sink_iter<_CharT>
+      // Called by the iterator for *it++ = c
+      constexpr void
+      _M_write(_CharT __c)
+      {
+	*_M_next++ = __c;
+	if (_M_next - _M_span.begin() == std::ssize(_M_span)) [[unlikely]]
+	  _M_overflow();
+      }
+
+      constexpr void
+      _M_write(basic_string_view<_CharT> __s)
+      {
+	span __to = _M_unused();
+	if (__to.size() <= __s.size()) [[unlikely]]
+	  return _M_write_overflowing(__s);
+	__s.copy(__to.data(), __s.size());
+	_M_next += __s.size();
+      }
+
+      // A pointer to __n unused characters in the span, or null if it does
+      // not have room for them. The characters written there become part of
+      // the output when _M_bump is called, which must happen before anything
+      // else is written to the sink.
+      [[__gnu__::__always_inline__]]
+      _CharT*
+      _M_reserve(size_t __n) const noexcept
+      {
+	span __to = _M_unused();
+	return __n <= __to.size() ? __to.data() : nullptr;
+      }
+
+      // Add __n characters written in place after a call to _M_reserve.
+      [[__gnu__::__always_inline__]]
+      void
+      _M_bump(size_t __n)
+      {
+	_M_next += __n;
+	if (_M_next - _M_span.begin() == std::ssize(_M_span)) [[unlikely]]
+	  _M_overflow();
+      }
+
+      // Write __n copies of __c straight into the span, calling _M_overflow()
+      // each time it fills up.
+      constexpr void
+      _M_write_fill(size_t __n, _CharT __c)
+      {
+	span __to = _M_unused();
+	while (__to.size() <= __n) [[unlikely]]
+	  {
+	    char_traits<_CharT>::assign(__to.data(), __to.size(), __c);
+	    _M_next += __to.size();
+	    __n -= __to.size();
+	    _M_overflow();
+	    if (_M_discarding) [[unlikely]]
+	      return;
+	    __to = _M_unused();
+	  }
+	char_traits<_CharT>::assign(__to.data(), __n, __c);
+	_M_next += __n;
+      }
+
+    public:
+      _Sink(const _Sink&) = delete;
+      _Sink& operator=(const _Sink&) = delete;
+
+      [[__gnu__::__always_inline__]]
+      constexpr _Sink_iter<_CharT>
       out() noexcept
       { return _Sink_iter<_CharT>(*this); }
     };
@@ -2466,6 +2922,98 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       }
     };
 
+  // A sink that appends to a string or vector. The sequence's spare capacity
+  // is used as the span, so output is written to it directly and is only
+  // copied again when the sequence grows. While formatting, the length of
+  // the sequence is the end of the span, and _M_finish() reduces it to the
+  // length of the output.
+  template<typename _Seq>
+    class _Seq_append_sink final : public _Sink<typename _Seq::value_type>
+    {
+      using _CharT = typename _Seq::value_type;
+
+      _Seq& _M_seq;
+      // The length of the sequence before the output was appended.
+      const size_t _M_start;
+
+      // Use the capacity after the first __used characters as the span,
+      // growing the sequence geometrically if it is all used.
+      void
+      _M_use_capacity(size_t __used)
+      {
+	_M_seq.resize(__used);
+	// vector::reserve allocates exactly what is asked for, so double the
+	// capacity here rather than rely on the sequence to do it.
+	if (__used == _M_seq.capacity())
+	  _M_seq.reserve(std::max(2 * _M_seq.capacity(), __used + 1));
+	size_t __cap = _M_seq.capacity();
+#if __cpp_lib_string_resize_and_overwrite
+	if constexpr (__is_specialization_of<_Seq, basic_string>)
+	  _M_seq.resize_and_overwrite(__cap, [](_CharT*, size_t __n) {
+	    return __n;
+	  });
+	else
+#endif
+	  {
+	    // resize value-initializes the new elements, so only expose part
+	    // of the spare capacity at a time, keeping the cost of a short
+	    // append independent of the capacity. The part doubles with the
+	    // length of the output.
+	    __cap = std::min(__cap, __used + std::max<size_t>(__used - _M_start,
+							      256));
+	    _M_seq.resize(__cap);
+	  }
+	span<_CharT> __s(_M_seq.data(), __cap);
+	this->_M_reset(__s, __s.begin() + __used);
+      }
+
+      void
+      _M_overflow() override
+      { _M_use_capacity(this->_M_used().size()); }
+
+    public:
+      // The span is empty until the body sets it to the sequence's capacity.
+      explicit
+      _Seq_append_sink(_Seq& __seq)
+      : _Sink<_CharT>(span<_CharT>()), _M_seq(__seq), _M_start(__seq.size())
+      { _M_use_capacity(__seq.size()); }
+
+      using _Sink<_CharT>::out;
+
+      void
+      _M_finish()
+      { _M_seq.resize(this->_M_used().size()); }
+    };
+
+  // A sink that fills a string, by appending to it in place.
+  template<typename _CharT, typename _Traits, typename _Alloc>
+    class _Seq_sink<basic_string<_CharT, _Traits, _Alloc>>
+    {
+      using _Seq = basic_string<_CharT, _Traits, _Alloc>;
+
+      _Seq _M_seq;
+      _Seq_append_sink<_Seq> _M_sink{_M_seq};
+
+    public:
+      _Seq_sink() = default;
+
+      _Seq_sink(_Seq&& __s)
+      : _M_seq(std::move(__s))
+      { }
+
+      [[__gnu__::__always_inline__]]
+      _Sink_iter<_CharT>
+      out() noexcept
+      { return _M_sink.out(); }
+
+      _Seq
+      get() &&
+      {
+	_M_sink._M_finish();
+	return std::move(_M_seq);
+      }
+    };
+
   template<typename _CharT, typename _Alloc = allocator<_CharT>>
     using _Str_sink
       = _Seq_sink<basic_string<_CharT, char_traits<_CharT>, _Alloc>>;
@@ -2546,10 +3094,10 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       _M_overflow()
       {
 	auto __s = this->_M_used();
-	_M_count += __s.size();
 
 	if (_M_max >= 0)
 	  {
+	    _M_count += __s.size();
 	    // Span was already sized for the maximum character count,
 	    // if it overflows then any further output must go to the
 	    // internal buffer, to be discarded.
@@ -2608,18 +3156,197 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       format_to_n_result<_OutIter>
       _M_finish() &&
       {
-	_Iter_sink::_M_overflow();
-	iter_difference_t<_OutIter> __count(_M_count);
 	auto __s = this->_M_used();
-	auto __last = _M_first;
-	if (__s.data() == _M_buf) // Wrote at least _M_max characters.
-	  __last += _M_max;
-	else
-	  __last += iter_difference_t<_OutIter>(__s.size());
-	return { __last, __count };
+	if (__s.data() == _M_buf)
+	  {
+	    // Switched to the internal buffer, so wrote _M_max characters.
+	    iter_difference_t<_OutIter> __count(_M_count + __s.size());
+	    return { _M_first + _M_max, __count };
+	  }
+	else // Everything fits in the output range.
+	  {
+	    iter_difference_t<_OutIter> __count(__s.size());
+	    return { _M_first + __count, __count };
+	  }
+      }
+    };
+
+  // A sink for format_to_n_truncated. Once more than the maximum number of
+  // characters have been written it asks for formatting to stop, instead of
+  // formatting the rest of the arguments just to count their size. The span
+  // is kept short enough to fill up, and call _M_overflow(), as soon as the
+  // output exceeds the maximum.
+  template<typename _CharT, typename _OutIter>
+    class _Truncating_sink final : public _Iter_sink<_CharT, _OutIter>
+    {
+      using _Base = _Iter_sink<_CharT, _OutIter>;
+
+      iter_difference_t<_OutIter> _M_limit;
+
+      // Stop formatting if the output exceeds the limit, otherwise shrink
+      // the span to one character more than the rest of the limit.
+      // Precondition: nothing has been written to the span yet.
+      void
+      _M_limit_span() noexcept
+      {
+	const auto __count = iter_difference_t<_OutIter>(this->_M_count);
+	if (__count > _M_limit)
+	  {
+	    this->_M_discarding = true;
+	    // Discard the rest a buffer at a time.
+	    if constexpr (!contiguous_iterator<_OutIter>)
+	      {
+		span<_CharT> __buf{this->_M_buf};
+		this->_M_reset(__buf, __buf.begin());
+	      }
+	    return;
+	  }
+	span<_CharT> __s = this->_M_unused();
+	const auto __room = _M_limit - __count + 1;
+	if (__room < iter_difference_t<_OutIter>(__s.size()))
+	  this->_M_reset(__s.first(size_t(__room)), __s.begin());
+      }
+
+      void
+      _M_overflow() override
+      {
+	_Base::_M_overflow();
+	if (!this->_M_discarding)
+	  _M_limit_span();
+      }
+
+    public:
+      explicit
+      _Truncating_sink(_OutIter __out, iter_difference_t<_OutIter> __n)
+      : _Base(std::move(__out), __n < 0 ? 0 : __n),
+	_M_limit(__n < 0 ? 0 : __n)
+      { _M_limit_span(); }
+
+      format_to_n_truncated_result<_OutIter>
+      _M_finish() &&
+      {
+	auto [__out, __size] = static_cast<_Base&&>(*this)._M_finish();
+	return { std::move(__out), this->_M_discarding || __size > _M_limit };
+      }
+    };
+
+  // A sink that writes to an array that is known to be large enough for
+  // all of the output, because it is no smaller than formatted_size_max.
+  // This never needs to find the size of the destination or extend the span,
+  // _M_overflow is only reached if the output fills the array exactly.
+  template<typename _CharT>
+    class _Fixed_sink final : public _Sink<_CharT>
+    {
+      _CharT* _M_last = nullptr; // The end of the output, once it is full.
+      _CharT _M_spare[1];
+
+      void
+      _M_overflow() override
+      {
+	if (!_M_last)
+	  {
+	    auto __s = this->_M_used();
+	    _M_last = __s.data() + __s.size();
+	  }
+	span<_CharT> __buf{_M_spare};
+	this->_M_reset(__buf, __buf.begin());
+      }
+
+    public:
+      template<size_t _Nm>
+	[[__gnu__::__always_inline__]]
+	explicit
+	_Fixed_sink(_CharT (&__buf)[_Nm]) noexcept
+	: _Sink<_CharT>(__buf)
+	{ }
+
+      _CharT*
+      _M_finish() noexcept
+      {
+	if (_M_last)
+	  return _M_last;
+	auto __s = this->_M_used();
+	return __s.data() + __s.size();
+      }
+    };
+} // namespace __format
+/// @endcond
+
+  /** Space reserved in the output of a formatting context, for a formatter
+   * to write characters in place instead of one at a time through the
+   * context's iterator.
+   *
+   * `data()` points to `size()` characters. They are in the output itself
+   * if it has room for them, otherwise in a scratch buffer. `commit(__n)`
+   * makes the first `__n` of them part of the output, and characters that
+   * are not committed are discarded. Nothing else may be written to the
+   * context's output between creating the reservation and committing it.
+   *
+   * This is an extension.
+   */
+  template<typename _CharT>
+    class basic_format_reservation
+    {
+      using _Iter = CXX20_FORMAT_DECORATE_NAME(__format)::_Sink_iter<_CharT>;
+
+      _Iter _M_out;
+      _CharT* _M_ptr;
+      size_t _M_size;
+      bool _M_in_place;
+      unique_ptr<_CharT[]> _M_heap;
+      _CharT _M_buf[32 * sizeof(void*) / sizeof(_CharT)];
+
+    public:
+      explicit
+      basic_format_reservation(basic_format_context<_Iter, _CharT>& __fc,
+			       size_t __n)
+      : _M_out(__fc.out()), _M_ptr(_M_out._M_reserve(__n)), _M_size(__n),
+	_M_in_place(_M_ptr)
+      {
+	if (!_M_in_place) [[unlikely]]
+	  {
+	    if (__n <= std::size(_M_buf))
+	      _M_ptr = _M_buf;
+	    else
+	      {
+		_M_heap.reset(new _CharT[__n]);
+		_M_ptr = _M_heap.get();
+	      }
+	  }
+      }
+
+      basic_format_reservation(const basic_format_reservation&) = delete;
+      basic_format_reservation&
+      operator=(const basic_format_reservation&) = delete;
+
+      [[nodiscard]]
+      _CharT*
+      data() const noexcept
+      { return _M_ptr; }
+
+      [[nodiscard]]
+      size_t
+      size() const noexcept
+      { return _M_size; }
+
+      // Call at most once.
+      void
+      commit(size_t __n)
+      {
+	__glibcxx_assert(__n <= _M_size);
+	if (_M_in_place) [[likely]]
+	  _M_out._M_bump(__n);
+	else if (__n)
+	  _M_out = basic_string_view<_CharT>(_M_ptr, __n);
       }
     };
 
+  using format_reservation = basic_format_reservation<char>;
+  using wformat_reservation = basic_format_reservation<wchar_t>;
+
+/// @cond undocumented
+namespace CXX20_FORMAT_DECORATE_NAME(__format)
+{
   enum _Arg_t : unsigned char {
     _Arg_none, _Arg_bool, _Arg_c, _Arg_i, _Arg_u, _Arg_ll, _Arg_ull,
     _Arg_flt, _Arg_dbl, _Arg_ldbl, _Arg_str, _Arg_sv, _Arg_ptr, _Arg_handle,
@@ -2761,10 +3488,155 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	}
       };
 
+  // The name of a named argument. This is a template argument of the
+  // argument's type, so that replacement fields which refer to it by name
+  // can be resolved to its index when the format string is checked.
+  template<typename _CharT, size_t _Nm>
+    struct _Arg_name
+    {
+      _CharT _M_str[_Nm];
+
+      consteval
+      _Arg_name(const _CharT (&__str)[_Nm])
+      {
+	for (size_t __i = 0; __i != _Nm; ++__i)
+	  _M_str[__i] = __str[__i];
+      }
+
+      constexpr basic_string_view<_CharT>
+      _M_view() const noexcept
+      { return {_M_str, _Nm - 1}; }
+    };
+
+  // A named argument, as returned by std::arg.
+  template<_Arg_name _Name, typename _Tp>
+    struct _Named_arg
+    {
+      static constexpr auto _S_name = _Name;
+      using _Value = _Tp;
+
+      const _Tp& _M_value;
+    };
+
+  template<typename _Tp>
+    constexpr bool __is_named_arg = false;
+
+  template<_Arg_name _Name, typename _Tp>
+    constexpr bool __is_named_arg<_Named_arg<_Name, _Tp>> = true;
+
+  // The type of the value of an argument, which may be a named argument.
+  template<typename _Tp>
+    struct __unnamed_arg
+    { using type = _Tp; };
+
+  template<typename _Tp>
+    requires __is_named_arg<remove_const_t<_Tp>>
+    struct __unnamed_arg<_Tp>
+    { using type = const typename _Tp::_Value; };
+
+  template<typename _Tp>
+    using __unnamed_arg_t = typename __unnamed_arg<_Tp>::type;
+
+  // The name of an argument of type _Tp, or an empty string.
+  template<typename _Tp, typename _CharT>
+    consteval basic_string_view<_CharT>
+    __arg_name()
+    {
+      if constexpr (__is_named_arg<remove_const_t<_Tp>>)
+	{
+	  constexpr auto __name = _Tp::_S_name._M_view();
+	  static_assert(is_same_v<decltype(__name), const basic_string_view<_CharT>>,
+			"the name of an argument must have the same character "
+			"type as the format string");
+	  return __name;
+	}
+      else
+	return {};
+    }
+
+  // A named argument and its index in the arguments.
+  template<typename _CharT>
+    struct _Arg_name_id
+    {
+      basic_string_view<_CharT> _M_name;
+      size_t _M_id;
+    };
+
+  // The named arguments in a basic_format_args, sorted by name.
+  template<typename _CharT>
+    struct _Arg_names
+    {
+      const _Arg_name_id<_CharT>* _M_ids;
+      size_t _M_size;
+
+      // The index of the argument called __name, or size_t(-1).
+      constexpr size_t
+      _M_find(basic_string_view<_CharT> __name) const noexcept
+      {
+	size_t __lo = 0, __hi = _M_size;
+	while (__lo != __hi)
+	  {
+	    const size_t __mid = (__lo + __hi) / 2;
+	    const int __cmp = _M_ids[__mid]._M_name.compare(__name);
+	    if (__cmp == 0)
+	      return _M_ids[__mid]._M_id;
+	    if (__cmp < 0)
+	      __lo = __mid + 1;
+	    else
+	      __hi = __mid;
+	  }
+	return -1;
+      }
+    };
+
+  // The character type of a basic_format_context, without completing it.
+  template<typename _Context>
+    struct __context_char;
+
+  template<typename _Out, typename _CharT>
+    struct __context_char<basic_format_context<_Out, _CharT>>
+    { using type = _CharT; };
+
+  template<typename _CharT, typename... _Args>
+    consteval auto
+    __make_arg_name_ids()
+    {
+      constexpr size_t __n = (__is_named_arg<_Args> + ... + 0);
+      array<_Arg_name_id<_CharT>, __n> __ids{};
+      const basic_string_view<_CharT> __names[] = {
+	__arg_name<_Args, _CharT>()..., {}
+      };
+      size_t __size = 0;
+      for (size_t __i = 0; __i != sizeof...(_Args); ++__i)
+	if (!__names[__i].empty())
+	  {
+	    // Insertion sort, the table is small.
+	    size_t __j = __size++;
+	    for (; __j != 0 && __names[__i] < __ids[__j - 1]._M_name; --__j)
+	      __ids[__j] = __ids[__j - 1];
+	    if (__j != 0 && __names[__i] == __ids[__j - 1]._M_name)
+	      __throw_format_error("format error: duplicate argument name");
+	    __ids[__j] = {__names[__i], __i};
+	  }
+      return __ids;
+    }
+
+  template<typename _CharT, typename... _Args>
+    constexpr auto __arg_name_ids = __make_arg_name_ids<_CharT, _Args...>();
+
+  template<typename _CharT, typename... _Args>
+    constexpr _Arg_names<_CharT> __arg_names{
+      __arg_name_ids<_CharT, _Args...>.data(),
+      __arg_name_ids<_CharT, _Args...>.size()
+    };
+
   // [format.arg.store], class template format-arg-store
   template<typename _Context, typename... _Args>
     class _Arg_store;
 
+  template<typename _CharT, typename _Store, typename... _Args>
+    class _Checking_scanner;
+
 } // namespace __format
 /// @endcond
 
@@ -2844,6 +3716,9 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       template<typename _Ctx, typename... _Args>
 	friend class CXX20_FORMAT_DECORATE_NAME(__format)::_Arg_store;
 
+      template<typename _Ch, typename _Store, typename... _Args>
+	friend class CXX20_FORMAT_DECORATE_NAME(__format)::_Checking_scanner;
+
       static_assert(is_trivially_copyable_v<CXX20_FORMAT_DECORATE_NAME(__format)::_Arg_value<_Context>>);
 
       CXX20_FORMAT_DECORATE_NAME(__format)::_Arg_value<_Context> _M_val;
@@ -3008,6 +3883,23 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	    return _Arg_handle;
 	}
 
+      // Like _Normalize, but keeps the name of a named argument, so that
+      // basic_format_args can find it.
+      template<typename _Tp>
+	static consteval auto
+	_S_to_store_type()
+	{
+	  using _Td = remove_const_t<_Tp>;
+	  if constexpr (CXX20_FORMAT_DECORATE_NAME(__format)::__is_named_arg<_Td>)
+	    return type_identity<CXX20_FORMAT_DECORATE_NAME(__format)::_Named_arg<_Td::_S_name,
+				   _Normalize<const typename _Td::_Value>>>();
+	  else
+	    return type_identity<_Normalize<_Tp>>();
+	}
+
+      template<typename _Tp>
+	using _Store_type = typename decltype(_S_to_store_type<_Tp>())::type;
+
       template<typename _Tp>
 	void
 	_M_set(_Tp __v) noexcept
@@ -3185,6 +4077,11 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	const _Format_arg* _M_args;       // Active when _M_packed_size == 0
       };
 
+      using _CharT = typename CXX20_FORMAT_DECORATE_NAME(__format)::__context_char<_Context>::type;
+
+      // The named arguments, if there are any.
+      const CXX20_FORMAT_DECORATE_NAME(__format)::_Arg_names<_CharT>* _M_names = nullptr;
+
       size_t
       _M_size() const noexcept
       { return _M_packed_size ? _M_packed_size : _M_unpacked_size; }
@@ -3204,7 +4101,10 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       template<typename... _Args>
 	static consteval array<CXX20_FORMAT_DECORATE_NAME(__format)::_Arg_t, sizeof...(_Args)>
 	_S_types_to_pack()
-	{ return {_Format_arg::template _S_to_enum<_Args>()...}; }
+	{
+	  return {_Format_arg::template _S_to_enum<
+		    remove_const_t<CXX20_FORMAT_DECORATE_NAME(__format)::__unnamed_arg_t<_Args>>>()...};
+	}
 
     public:
       basic_format_args() noexcept = default;
@@ -3226,10 +4126,39 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	  __arg = _M_args[__i];
 	return __arg;
       }
-    };
 
-  // _GLIBCXX_RESOLVE_LIB_DEFECTS
-  // 3810. CTAD for std::basic_format_args
+      // A non-zero value identifying the number and types of the arguments,
+      // or zero if that is not cheap to determine because they are unpacked,
+      // or if it is not enough because some of them are named.
+      // No argument has type _Arg_none, so the packed types alone also tell
+      // how many arguments there are.
+      uint64_t
+      _M_packed_types() const noexcept
+      { return _M_packed_size && !_M_names ? _M_unpacked_size : 0; }
+
+      // The value of _M_packed_types() for arguments of types _Args...
+      template<typename... _Args>
+	static consteval uint64_t
+	_S_packed_types_of()
+	{
+	  if constexpr (sizeof...(_Args) == 0
+			  || sizeof...(_Args) > _S_max_packed_args
+			  || (CXX20_FORMAT_DECORATE_NAME(__format)::__is_named_arg<_Args> || ...))
+	    return 0;
+	  else
+	    return CXX20_FORMAT_DECORATE_NAME(__format)::__pack_arg_types<_S_packed_type_bits>(
+		     _S_types_to_pack<typename _Format_arg::template
+					_Store_type<const _Args>...>());
+	}
+
+      // The index of the named argument called __name, or size_t(-1).
+      size_t
+      _M_named_arg_id(basic_string_view<_CharT> __name) const noexcept
+      { return _M_names ? _M_names->_M_find(__name) : size_t(-1); }
+    };
+
+  // _GLIBCXX_RESOLVE_LIB_DEFECTS
+  // 3810. CTAD for std::basic_format_args
   template<typename _Context, typename... _Args>
     basic_format_args(CXX20_FORMAT_DECORATE_NAME(__format)::_Arg_store<_Context, _Args...>)
       -> basic_format_args<_Context>;
@@ -3264,11 +4193,16 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	static _Element_t
 	_S_make_elt(_Tp& __v)
 	{
-	  basic_format_arg<_Context> __arg(__v);
-	  if constexpr (_S_values_only)
-	    return __arg._M_val;
+	  if constexpr (CXX20_FORMAT_DECORATE_NAME(__format)::__is_named_arg<remove_const_t<_Tp>>)
+	    return _S_make_elt(__v._M_value);
 	  else
-	    return __arg;
+	    {
+	      basic_format_arg<_Context> __arg(__v);
+	      if constexpr (_S_values_only)
+		return __arg._M_val;
+	      else
+		return __arg;
+	    }
 	}
 
       template<typename... _Tp>
@@ -3313,6 +4247,8 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	    // The basic_format_arg objects:
 	    _M_args = __store._M_args;
 	  }
+	if constexpr ((CXX20_FORMAT_DECORATE_NAME(__format)::__is_named_arg<_Args> || ...))
+	  _M_names = &CXX20_FORMAT_DECORATE_NAME(__format)::__arg_names<_CharT, _Args...>;
       }
 
   /// Capture formatting arguments for use by `std::vformat`.
@@ -3323,7 +4259,7 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     {
       using _Fmt_arg = basic_format_arg<_Context>;
       using _Store = CXX20_FORMAT_DECORATE_NAME(__format)::_Arg_store<_Context, typename _Fmt_arg::template
-		     _Normalize<remove_reference_t<_Args>>...>;
+		     _Store_type<remove_reference_t<_Args>>...>;
       return _Store(__fmt_args...);
     }
 
@@ -3334,14 +4270,34 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     make_wformat_args(_Args&&... __args) noexcept
     { return std::make_format_args<wformat_context>(__args...); }
 
+  /** A named formatting argument.
+   *
+   * The argument can be referred to as `{name}` in a replacement field,
+   * e.g. `std::format("{user} logged in", std::arg<"user">(name))`.
+   * Because the name is part of the type, such fields are resolved to the
+   * argument's index when the format string is checked at compile-time.
+   *
+   * This is an extension.
+   */
+  template<CXX20_FORMAT_DECORATE_NAME(__format)::_Arg_name _Name, typename _Tp>
+    [[nodiscard,__gnu__::__always_inline__]]
+    inline CXX20_FORMAT_DECORATE_NAME(__format)::_Named_arg<_Name, _Tp>
+    arg(const _Tp& __value) noexcept
+    { return {__value}; }
+
 /// @cond undocumented
 namespace CXX20_FORMAT_DECORATE_NAME(__format)
 {
   template<typename _Out, typename _CharT, typename _Context>
     _Out
-    __do_vformat_to(_Out, basic_string_view<_CharT>,
+    __do_vformat_to(_Out, _Field_span<_CharT>,
 		    const basic_format_args<_Context>&,
-		    const locale* = nullptr);
+		    const locale* = nullptr, pmr::memory_resource* = nullptr);
+
+  template<typename _CharT, typename _Context>
+    size_t
+    __formatted_size(_Field_span<_CharT>, const basic_format_args<_Context>&,
+		     const locale* = nullptr);
 } // namespace __format
 /// @endcond
 
@@ -3361,6 +4317,7 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       basic_format_args<basic_format_context> _M_args;
       _Out _M_out;
       CXX20_FORMAT_DECORATE_NAME(__format)::_Optional_locale _M_loc;
+      pmr::memory_resource* _M_mr = nullptr;
 
       basic_format_context(basic_format_args<basic_format_context> __args,
 			   _Out __out)
@@ -3374,9 +4331,15 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 
       template<typename _Out2, typename _CharT2, typename _Context2>
 	friend _Out2
-	CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(_Out2, basic_string_view<_CharT2>,
+	CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(_Out2, CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<_CharT2>,
 				  const basic_format_args<_Context2>&,
-				  const locale*);
+				  const locale*, pmr::memory_resource*);
+
+      template<typename _CharT2, typename _Context2>
+	friend size_t
+	CXX20_FORMAT_DECORATE_NAME(__format)::__formatted_size(CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<_CharT2>,
+				   const basic_format_args<_Context2>&,
+				   const locale*);
 
     public:
       basic_format_context() = default;
@@ -3392,12 +4355,22 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       arg(size_t __id) const noexcept
       { return _M_args.get(__id); }
 
+      // The index of the named argument called __name, or size_t(-1).
+      size_t
+      _M_arg_id(basic_string_view<_CharT> __name) const noexcept
+      { return _M_args._M_named_arg_id(__name); }
+
       [[nodiscard]]
       std::locale locale() { return _M_loc.value(); }
 
       [[nodiscard]]
       iterator out() { return std::move(_M_out); }
 
+      // The memory resource for temporary strings used while formatting.
+      pmr::memory_resource*
+      _M_resource() const noexcept
+      { return _M_mr ? _M_mr : pmr::new_delete_resource(); }
+
       void advance_to(iterator __it) { _M_out = std::move(__it); }
     };
 
@@ -3414,12 +4387,365 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       __ctx.advance_to(CXX20_FORMAT_DECORATE_NAME(__format)::__write(__ctx.out()));
     }
 
-  // Abstract base class defining an interface for scanning format strings.
+  // A replacement field in a format string, together with the literal text
+  // that precedes it. These are recorded by _Checking_scanner so that a
+  // format string that was checked at compile-time can be formatted without
+  // scanning it for braces and parsing its format-specs again.
+  template<typename _CharT>
+    struct _Field
+    {
+      unsigned short _M_lit_pos = 0; // Offset of the preceding literal text.
+      unsigned short _M_lit_len = 0; // Length of the preceding literal text.
+      unsigned short _M_id = 0;      // The arg-id of the replacement field.
+      bool _M_lit_esc = false;       // Literal text contains "{{" or "}}".
+      bool _M_no_spec = false;       // The field has no format-spec.
+      _Spec<_CharT> _M_spec{};       // The parsed format-spec.
+
+      // Add the literal text in [__pos, __end) to the preceding text.
+      constexpr void
+      _M_add_literal(size_t __pos, size_t __end) noexcept
+      {
+	if (_M_lit_len == 0)
+	  _M_lit_pos = __pos;
+	else // The previous chunk ended at an escaped brace.
+	  _M_lit_esc = true;
+	_M_lit_len = __end - _M_lit_pos;
+      }
+    };
+
+  // A non-owning view of recorded replacement fields.
+  // If _M_fields is null the format string must be scanned at runtime.
+  template<typename _CharT>
+    struct _Field_span
+    {
+      basic_string_view<_CharT> _M_str;
+      const _Field<_CharT>* _M_fields = nullptr;
+      size_t _M_size = 0;
+    };
+
+  // Fixed-capacity storage for the replacement fields of a format string
+  // with _Nm arguments. A format string that uses automatic indexing cannot
+  // have more than _Nm replacement fields, but one using manual indexing can.
+  // In that case, or if any argument needs a formatter that is not one of the
+  // library's own, _M_valid is false and the string is scanned at runtime.
+  template<typename _CharT, size_t _Nm>
+    struct _Field_store
+    {
+      // _M_size replacement fields, followed by the trailing literal text.
+      _Field<_CharT> _M_fields[_Nm + 1]{};
+      unsigned short _M_size = 0;
+      bool _M_valid = false;
+
+      // The field that is currently being recorded.
+      constexpr _Field<_CharT>&
+      _M_back() noexcept
+      { return _M_fields[_M_size]; }
+
+      // Finish recording the current replacement field.
+      constexpr void
+      _M_push() noexcept
+      {
+	if (_M_size == _Nm)
+	  _M_valid = false;
+	else
+	  ++_M_size;
+      }
+
+      constexpr _Field_span<_CharT>
+      _M_span(basic_string_view<_CharT> __str) const noexcept
+      {
+	if (_M_valid)
+	  return { __str, _M_fields, _M_size };
+	return { __str };
+      }
+    };
+
+  // Storage for any number of replacement fields, used for format strings
+  // that are compiled at runtime.
+  template<typename _CharT>
+    struct _Field_store<_CharT, dynamic_extent>
+    {
+      vector<_Field<_CharT>> _M_fields = vector<_Field<_CharT>>(1);
+      bool _M_valid = false;
+
+      _Field<_CharT>&
+      _M_back() noexcept
+      { return _M_fields.back(); }
+
+      void
+      _M_push()
+      { _M_fields.emplace_back(); }
+
+      _Field_span<_CharT>
+      _M_span(basic_string_view<_CharT> __str) const noexcept
+      {
+	if (_M_valid)
+	  return { __str, _M_fields.data(), _M_fields.size() - 1 };
+	return { __str };
+      }
+    };
+
+  // The library formatter used by std::formatter<_Tp, _CharT>, where _Tp is
+  // one of the types stored in basic_format_arg. This is void for handle,
+  // i.e. when the type is formatted by a program-defined formatter.
+  template<typename _Tp, typename _CharT>
+    consteval auto
+    __builtin_formatter()
+    {
+      if constexpr (__is_one_of<_Tp, bool, _CharT, int, unsigned,
+				 long long, unsigned long long>::value)
+	return type_identity<__formatter_int<_CharT>>();
+#ifdef __SIZEOF_INT128__
+      else if constexpr (__is_one_of<_Tp, __int128, unsigned __int128>::value)
+	return type_identity<__formatter_int<_CharT>>();
+#endif
+      else if constexpr (__formattable_float<_Tp>)
+	return type_identity<__formatter_fp<_CharT>>();
+      else if constexpr (__is_one_of<_Tp, const _CharT*,
+				      basic_string_view<_CharT>>::value)
+	return type_identity<__formatter_str<_CharT>>();
+      else if constexpr (is_same_v<_Tp, const void*>)
+	return type_identity<__formatter_ptr<_CharT>>();
+      else
+	return type_identity<void>();
+    }
+
+  template<typename _Tp, typename _CharT>
+    using __builtin_formatter_t
+      = typename decltype(__builtin_formatter<_Tp, _CharT>())::type;
+
+  // Parse the format-spec for an argument of type _Tp, where
+  // __builtin_formatter_t<_Tp, _CharT> is not void.
+  template<typename _Tp, typename _CharT>
+    constexpr _Spec<_CharT>
+    __parse_builtin_spec(basic_format_parse_context<_CharT>& __pc)
+    {
+      __builtin_formatter_t<_Tp, _CharT> __f;
+      if constexpr (is_same_v<decltype(__f), __formatter_int<_CharT>>)
+	__pc.advance_to(__f.template _M_parse<_Tp>(__pc));
+      else
+	__pc.advance_to(__f.parse(__pc));
+      return __f._M_spec;
+    }
+
+  // The unsigned type with the digits of the integer type _Tp, or of bool.
+  // Unlike make_unsigned_t, this supports __int128 in strict mode.
+  template<typename _Tp>
+    using __unsigned_digits_t
+      = typename conditional_t<is_same_v<_Tp, bool>,
+			       type_identity<unsigned char>,
+#if defined __SIZEOF_INT128__ && defined __STRICT_ANSI__
+			       conditional_t<(sizeof(_Tp) > sizeof(long long)),
+					     type_identity<unsigned __int128>,
+					     make_unsigned<_Tp>>
+#else
+			       make_unsigned<_Tp>
+#endif
+			      >::type;
+
+  // An upper bound of the number of characters written for an argument of
+  // type _Tp with the parsed format-spec __spec, where
+  // __builtin_formatter_t<_Tp, _CharT> is not void. Returns size_t(-1) if
+  // the output is not bounded, or depends on the locale or another argument.
+  template<typename _Tp, typename _CharT>
+    constexpr size_t
+    __max_formatted_size(const _Spec<_CharT>& __spec) noexcept
+    {
+      constexpr size_t __unbounded = __gnu_cxx::__int_traits<size_t>::__max;
+      if (__spec._M_width_kind == _WP_from_arg
+	    || __spec._M_prec_kind == _WP_from_arg || __spec._M_localized)
+	return __unbounded;
+
+      size_t __n = __unbounded;
+      if constexpr (__is_one_of<_Tp, const _CharT*,
+				 basic_string_view<_CharT>>::value)
+	{
+	  if (__spec._M_prec_kind == _WP_value && __spec._M_type != _Pres_esc)
+	    __n = __spec._M_prec;
+	}
+      else if constexpr (is_same_v<_Tp, const void*>)
+	__n = 2 + 2 * sizeof(void*);
+      else if constexpr (__formattable_float<_Tp>)
+	{
+	  using _Lim = numeric_limits<_Tp>;
+	  if constexpr (_Lim::is_specialized)
+	    {
+	      using CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_len;
+	      // Digits in the largest decimal and binary exponents.
+	      constexpr size_t __exp10
+		= __to_chars_len(unsigned(_Lim::max_digits10
+					    - _Lim::min_exponent10));
+	      constexpr size_t __exp2
+		= __to_chars_len(unsigned(_Lim::digits - _Lim::min_exponent));
+	      const bool __has_prec = __spec._M_prec_kind == _WP_value;
+	      const size_t __prec = __has_prec ? __spec._M_prec : 6;
+	      // The sign, the radix point, and the exponent's letter and sign
+	      // account for four characters.
+	      switch (__spec._M_type)
+		{
+		case _Pres_none:
+		  if (!__has_prec)
+		    {
+		      __n = 4 + _Lim::max_digits10 + __exp10;
+		      break;
+		    }
+		  [[fallthrough]];
+		case _Pres_g:
+		case _Pres_G:
+		  // Fixed notation is used down to 1e-4, adding "0.000".
+		  __n = 8 + std::max<size_t>(__prec, 1) + __exp10;
+		  break;
+		case _Pres_e:
+		case _Pres_E:
+		  __n = 5 + __prec + __exp10;
+		  break;
+		case _Pres_f:
+		  __n = 3 + _Lim::max_exponent10 + __prec;
+		  break;
+		case _Pres_a:
+		case _Pres_A:
+		  __n = 5 + __exp2
+			  + (__has_prec ? __prec : (_Lim::digits + 2) / 4);
+		  break;
+		default:
+		  break;
+		}
+	    }
+	}
+      else // Integers, bool and _CharT.
+	{
+	  using _Up = __unsigned_digits_t<_Tp>;
+	  constexpr size_t __bits = __gnu_cxx::__int_traits<_Up>::__digits;
+	  switch (__spec._M_type)
+	    {
+	    case _Pres_none:
+	      if constexpr (is_same_v<_Tp, bool>)
+		{
+		  __n = 5; // "false"
+		  break;
+		}
+	      else if constexpr (is_same_v<_Tp, _CharT>)
+		{
+		  __n = 1;
+		  break;
+		}
+	      [[fallthrough]];
+	    case _Pres_d:
+	      __n = 1 + CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_len(_Up(-1));
+	      break;
+	    case _Pres_b:
+	    case _Pres_B:
+	      __n = 3 + __bits;
+	      break;
+	    case _Pres_o:
+	      __n = 2 + (__bits + 2) / 3;
+	      break;
+	    case _Pres_x:
+	    case _Pres_X:
+	      __n = 3 + (__bits + 3) / 4;
+	      break;
+	    case _Pres_c:
+	      __n = 1;
+	      break;
+	    default:
+	      break;
+	    }
+	}
+
+      // There is at most one separator for every three digits.
+      if (__n != __unbounded && __spec._M_group != _Group_none)
+	__n += __n / 3;
+      if (__n != __unbounded && __spec._M_width_kind == _WP_value)
+	__n = std::max<size_t>(__n, __spec._M_width);
+      return __n;
+    }
+
+  // A small per-thread cache of the replacement fields of format strings
+  // that were not checked at compile-time, so that formatting the same
+  // string again with the same argument types does not scan it and parse
+  // its format-specs again. Strings are identified by their address, length
+  // and argument types, and their contents are compared as well, so that
+  // a buffer that is reused for a different string does not match.
+  template<typename _CharT>
+    struct _Field_cache
+    {
+      using _Store = _Field_store<_CharT, dynamic_extent>;
+
+      struct _Entry
+      {
+	const _CharT* _M_ptr = nullptr;
+	__UINT64_TYPE__ _M_types = 0;
+	basic_string<_CharT> _M_str;
+	_Store _M_fields;
+      };
+
+      // The maximum number of format strings in the cache.
+      static constexpr unsigned _S_size = 16;
+
+      _Entry _M_entries[_S_size];
+      unsigned _M_next = 0; // The entry to replace next.
+
+      const _Store*
+      _M_find(basic_string_view<_CharT> __str,
+	      __UINT64_TYPE__ __types) const noexcept
+      {
+	for (const _Entry& __e : _M_entries)
+	  if (__e._M_ptr == __str.data() && __e._M_types == __types
+		&& basic_string_view<_CharT>(__e._M_str) == __str)
+	    return &__e._M_fields;
+	return nullptr;
+      }
+
+      void
+      _M_insert(basic_string_view<_CharT> __str, __UINT64_TYPE__ __types,
+		_Store&& __fields)
+      {
+	_Entry& __e = _M_entries[_M_next];
+	_M_next = (_M_next + 1) % _S_size;
+	__e._M_ptr = nullptr; // In case assigning the string throws.
+	__e._M_str = __str;
+	__e._M_fields = std::move(__fields);
+	__e._M_types = __types;
+	__e._M_ptr = __str.data();
+      }
+
+      static _Field_cache&
+      _S_get() noexcept
+      {
+	static thread_local _Field_cache __cache;
+	return __cache;
+      }
+    };
+
+  // Find the first '{' or '}' in [__first, __last), using SIMD instructions
+  // if the CPU supports them. These are defined in the library.
+  const char*
+  __find_brace_simd(const char* __first, const char* __last) noexcept;
+
+  const wchar_t*
+  __find_brace_simd(const wchar_t* __first, const wchar_t* __last) noexcept;
+
+  // Find the first '{' or '}' in [__first, __last), or return __last.
+  template<typename _CharT>
+    constexpr const _CharT*
+    __find_brace(const _CharT* __first, const _CharT* __last) noexcept
+    {
+      // Short strings are not worth the call into the library.
+      if (!std::is_constant_evaluated() && __last - __first >= 16)
+	return CXX20_FORMAT_DECORATE_NAME(__format)::__find_brace_simd(__first, __last);
+      for (; __first != __last; ++__first)
+	if (*__first == '{' || *__first == '}')
+	  break;
+      return __first;
+    }
+
+  // Base class defining an interface for scanning format strings.
   // Scan the characters in a format string, dividing it up into strings of
   // ordinary characters, escape sequences, and replacement fields.
-  // Call virtual functions for derived classes to parse format-specifiers
-  // or write formatted output.
-  template<typename _CharT>
+  // Call _M_on_chars and _M_format_arg on the _Derived class to parse
+  // format-specifiers or write formatted output. These are not virtual, so
+  // they can be inlined into _M_scan.
+  template<typename _CharT, typename _Derived>
     struct _Scanner
     {
       using iterator = typename basic_format_parse_context<_CharT>::iterator;
@@ -3442,57 +4768,57 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	if (__fmt.size() == 2 && __fmt[0] == '{' && __fmt[1] == '}')
 	  {
 	    _M_pc.advance_to(begin() + 1);
-	    _M_format_arg(_M_pc.next_arg_id());
+	    _M_derived()._M_format_arg(_M_pc.next_arg_id());
 	    return;
 	  }
 
-	size_t __lbr = __fmt.find('{');
-	size_t __rbr = __fmt.find('}');
+	// The first '}' after the last replacement field that was found,
+	// used to diagnose a '{' that is never closed.
+	iterator __rbr = begin();
 
-	while (__fmt.size())
+	while (begin() != end())
 	  {
-	    auto __cmp = __lbr <=> __rbr;
-	    if (__cmp == 0)
+	    if (_M_derived()._M_stopped()) [[unlikely]]
+	      return;
+
+	    // Find both kinds of brace in a single pass over the string.
+	    iterator __brace = CXX20_FORMAT_DECORATE_NAME(__format)::__find_brace(begin(), end());
+	    if (__brace == end())
 	      {
-		_M_on_chars(end());
+		_M_derived()._M_on_chars(end());
 		_M_pc.advance_to(end());
 		return;
 	      }
-	    else if (__cmp < 0)
+
+	    const bool __is_last = __brace + 1 == end();
+	    if (*__brace == '{')
 	      {
-		if (__lbr + 1 == __fmt.size()
-		      || (__rbr == __fmt.npos && __fmt[__lbr + 1] != '{'))
-		  CXX20_FORMAT_DECORATE_NAME(__format)::__unmatched_left_brace_in_format_string();
-		const bool __is_escape = __fmt[__lbr + 1] == '{';
-		iterator __last = begin() + __lbr + int(__is_escape);
-		_M_on_chars(__last);
-		_M_pc.advance_to(__last + 1);
-		__fmt = _M_fmt_str();
-		if (__is_escape)
+		if (!__is_last && __brace[1] == '{')
 		  {
-		    if (__rbr != __fmt.npos)
-		      __rbr -= __lbr + 2;
-		    __lbr = __fmt.find('{');
+		    _M_derived()._M_on_chars(__brace + 1);
+		    _M_pc.advance_to(__brace + 2);
+		    continue;
 		  }
-		else
+		if (__rbr <= __brace && !__is_last)
 		  {
-		    _M_on_replacement_field();
-		    __fmt = _M_fmt_str();
-		    __lbr = __fmt.find('{');
-		    __rbr = __fmt.find('}');
+		    __rbr = char_traits<_CharT>::find(__brace + 1,
+						      end() - (__brace + 1),
+						      _CharT('}'));
+		    if (!__rbr)
+		      __rbr = end();
 		  }
+		if (__is_last || __rbr == end())
+		  CXX20_FORMAT_DECORATE_NAME(__format)::__unmatched_left_brace_in_format_string();
+		_M_derived()._M_on_chars(__brace);
+		_M_pc.advance_to(__brace + 1);
+		_M_on_replacement_field();
 	      }
 	    else
 	      {
-		if (++__rbr == __fmt.size() || __fmt[__rbr] != '}')
+		if (__is_last || __brace[1] != '}')
 		  CXX20_FORMAT_DECORATE_NAME(__format)::__unmatched_right_brace_in_format_string();
-		iterator __last = begin() + __rbr;
-		_M_on_chars(__last);
-		_M_pc.advance_to(__last + 1);
-		__fmt = _M_fmt_str();
-		if (__lbr != __fmt.npos)
-		  __lbr -= __rbr + 1;
-		__rbr = __fmt.find('}');
+		_M_derived()._M_on_chars(__brace + 1);
+		_M_pc.advance_to(__brace + 2);
 	      }
 	  }
       }
@@ -3501,7 +4827,11 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       _M_fmt_str() const noexcept
       { return {begin(), end()}; }
 
-      constexpr virtual void _M_on_chars(iterator) { }
+      // Literal text is ignored unless the derived class hides this.
+      constexpr void _M_on_chars(iterator) { }
+
+      // Scanning never stops early unless the derived class hides this.
+      constexpr bool _M_stopped() const noexcept { return false; }
 
       constexpr void _M_on_replacement_field()
       {
@@ -3515,6 +4845,23 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	    __id = _M_pc.next_arg_id();
 	    _M_pc.advance_to(++__next);
 	  }
+	else if (*__next == '_' || ('a' <= *__next && *__next <= 'z')
+		   || ('A' <= *__next && *__next <= 'Z'))
+	  {
+	    // A named argument. This does not affect automatic indexing.
+	    auto __ptr = __next;
+	    while (++__ptr != end()
+		     && (*__ptr == '_' || ('a' <= *__ptr && *__ptr <= 'z')
+			   || ('A' <= *__ptr && *__ptr <= 'Z')
+			   || ('0' <= *__ptr && *__ptr <= '9')))
+	      { }
+	    if (__ptr == end() || !(*__ptr == '}' || *__ptr == ':'))
+	      CXX20_FORMAT_DECORATE_NAME(__format)::__invalid_arg_id_in_format_string();
+	    __id = _M_derived()._M_named_arg_id({__next, __ptr});
+	    if (*__ptr == ':')
+	      ++__ptr;
+	    _M_pc.advance_to(__ptr);
+	  }
 	else
 	  {
 	    auto [__i, __ptr] = CXX20_FORMAT_DECORATE_NAME(__format)::__parse_arg_id(begin(), end());
@@ -3528,50 +4875,124 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	    else
 	      _M_pc.advance_to(__ptr);
 	  }
-	_M_format_arg(__id);
+	_M_derived()._M_format_arg(__id);
+	// The format-spec must be followed by the closing brace.
+	if (begin() == end() || *begin() != '}')
+	  CXX20_FORMAT_DECORATE_NAME(__format)::__unmatched_left_brace_in_format_string();
 	_M_pc.advance_to(_M_pc.begin() + 1); // Move past '}'
       }
 
-      constexpr virtual void _M_format_arg(size_t __id) = 0;
+    private:
+      [[__gnu__::__always_inline__]]
+      constexpr _Derived&
+      _M_derived() noexcept
+      { return static_cast<_Derived&>(*this); }
     };
 
   // Process a format string and format the arguments in the context.
   template<typename _Out, typename _CharT>
-    class _Formatting_scanner : public _Scanner<_CharT>
+    class _Formatting_scanner
+    : public _Scanner<_CharT, _Formatting_scanner<_Out, _CharT>>
     {
+      using _Base = _Scanner<_CharT, _Formatting_scanner>;
+      friend _Base;
+
     public:
       _Formatting_scanner(basic_format_context<_Out, _CharT>& __fc,
 			  basic_string_view<_CharT> __str)
-      : _Scanner<_CharT>(__str), _M_fc(__fc)
+      : _Base(__str), _M_fc(__fc)
       { }
 
+      using _Base::_M_scan;
+
+      // Scan the format string and format the arguments, and also record
+      // the replacement fields in __fields so that they can be replayed.
+      void
+      _M_scan(_Field_store<_CharT, dynamic_extent>& __fields)
+      {
+	_M_record = &__fields;
+	_M_first = this->begin();
+	__fields._M_valid = this->end() - _M_first
+			      <= __gnu_cxx::__int_traits<unsigned short>::__max;
+	this->_M_scan();
+	_M_record = nullptr;
+	if (_M_stopped()) // The fields after the last one formatted are missing.
+	  __fields._M_valid = false;
+      }
+
     private:
       basic_format_context<_Out, _CharT>& _M_fc;
 
-      using iterator = typename _Scanner<_CharT>::iterator;
+      using iterator = typename _Base::iterator;
+
+      _Field_store<_CharT, dynamic_extent>* _M_record = nullptr;
+      iterator _M_first{};
+
+      // True if the sink discards all further output.
+      bool
+      _M_stopped() const noexcept
+      {
+	if constexpr (is_same_v<_Out, _Sink_iter<_CharT>>)
+	  return _M_fc.out()._M_discarding();
+	else
+	  return false;
+      }
 
       void
-      _M_on_chars(iterator __last) override
+      _M_on_chars(iterator __last)
       {
 	basic_string_view<_CharT> __str(this->begin(), __last);
 	_M_fc.advance_to(CXX20_FORMAT_DECORATE_NAME(__format)::__write(_M_fc.out(), __str));
+	if (_M_record && _M_record->_M_valid && !__str.empty()) [[unlikely]]
+	  _M_record->_M_back()._M_add_literal(this->begin() - _M_first,
+					      __last - _M_first);
+      }
+
+      size_t
+      _M_named_arg_id(basic_string_view<_CharT> __name)
+      {
+	const size_t __id = _M_fc._M_arg_id(__name);
+	if (__id == size_t(-1))
+	  CXX20_FORMAT_DECORATE_NAME(__format)::__invalid_arg_id_in_format_string();
+	return __id;
       }
 
       void
-      _M_format_arg(size_t __id) override
+      _M_format_arg(size_t __id)
       {
 	using _Context = basic_format_context<_Out, _CharT>;
 	using handle = typename basic_format_arg<_Context>::handle;
 
-	std::visit_format_arg([this](auto& __arg) {
+	std::visit_format_arg([this, __id](auto& __arg) {
 	  using _Type = remove_reference_t<decltype(__arg)>;
 	  using _Formatter = typename _Context::template formatter_type<_Type>;
 	  if constexpr (is_same_v<_Type, monostate>)
 	    CXX20_FORMAT_DECORATE_NAME(__format)::__invalid_arg_id_in_format_string();
 	  else if constexpr (is_same_v<_Type, handle>)
-	    __arg.format(this->_M_pc, this->_M_fc);
+	    {
+	      if (_M_record) // Cannot record the state of this formatter.
+		_M_record->_M_valid = false;
+	      __arg.format(this->_M_pc, this->_M_fc);
+	    }
 	  else if constexpr (is_default_constructible_v<_Formatter>)
 	    {
+	      const bool __no_spec = *this->begin() == '}';
+	      if (_M_record && _M_record->_M_valid) [[unlikely]]
+		{
+		  // Parse with the library formatter that _Formatter uses,
+		  // so that the parsed format-spec can be recorded.
+		  auto __spec = CXX20_FORMAT_DECORATE_NAME(__format)::__parse_builtin_spec<_Type>(this->_M_pc);
+		  _Field<_CharT>& __f = _M_record->_M_back();
+		  __f._M_id = __id;
+		  __f._M_no_spec = __no_spec;
+		  __f._M_spec = __spec;
+		  _M_record->_M_push();
+		  if (!__no_spec || !_M_format_default(__arg))
+		    _M_format_builtin(__arg, __spec);
+		  return;
+		}
+	      if (__no_spec && _M_format_default(__arg))
+		return;
 	      _Formatter __f;
 	      this->_M_pc.advance_to(__f.parse(this->_M_pc));
 	      this->_M_fc.advance_to(__f.format(__arg, this->_M_fc));
@@ -3580,72 +5001,462 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	    static_assert(CXX20_FORMAT_DECORATE_NAME(__format)::__formattable_with<_Type, _Context>);
 	}, _M_fc.arg(__id));
       }
-    };
-
-  // Validate a format string for Args.
-  template<typename _CharT, typename... _Args>
-    class _Checking_scanner : public _Scanner<_CharT>
-    {
-      static_assert(
-	(is_default_constructible_v<formatter<_Args, _CharT>> && ...),
-	"std::formatter must be specialized for each type being formatted");
 
     public:
-      constexpr
-      _Checking_scanner(basic_string_view<_CharT> __str)
-      : _Scanner<_CharT>(__str, sizeof...(_Args))
-      { }
+      // Format the arguments using the replacement fields that were recorded
+      // when the format string was checked, instead of scanning it again.
+      void
+      _M_replay(const _Field_span<_CharT>& __fields)
+      {
+	for (size_t __i = 0; ; ++__i)
+	  {
+	    const _Field<_CharT>& __f = __fields._M_fields[__i];
+	    if (__f._M_lit_len)
+	      _M_write_literal(__fields._M_str.substr(__f._M_lit_pos,
+						      __f._M_lit_len),
+			       __f._M_lit_esc);
+	    if (__i == __fields._M_size || _M_stopped())
+	      return;
+	    _M_format_arg(__f);
+	  }
+      }
+
+      // Compute the length of the output of _M_replay(__fields), without
+      // formatting the arguments whose length can be computed from their
+      // value and format-spec. The other arguments are formatted to the
+      // context's iterator, and the length of that output must be added.
+      size_t
+      _M_measure(const _Field_span<_CharT>& __fields)
+      {
+	size_t __n = 0;
+	for (size_t __i = 0; ; ++__i)
+	  {
+	    const _Field<_CharT>& __f = __fields._M_fields[__i];
+	    __n += __f._M_lit_len;
+	    if (__f._M_lit_esc)
+	      __n -= _S_count_escapes(__fields._M_str.substr(__f._M_lit_pos,
+							     __f._M_lit_len));
+	    if (__i == __fields._M_size)
+	      return __n;
+	    std::visit_format_arg([this, &__f, &__n](auto& __arg) {
+	      using _Type = remove_reference_t<decltype(__arg)>;
+	      if constexpr (is_void_v<__builtin_formatter_t<_Type, _CharT>>)
+		CXX20_FORMAT_DECORATE_NAME(__format)::__invalid_arg_id_in_format_string();
+	      else if (size_t __len = _M_measure_arg(__arg, __f._M_spec);
+		       __len != size_t(-1))
+		__n += __len;
+	      else if (!__f._M_no_spec || !_M_format_default(__arg))
+		_M_format_builtin(__arg, __f._M_spec);
+	    }, _M_fc.arg(__f._M_id));
+	  }
+      }
 
     private:
-      constexpr void
-      _M_format_arg(size_t __id) override
+      // The number of escape sequences "{{" and "}}" in literal text.
+      static size_t
+      _S_count_escapes(basic_string_view<_CharT> __str) noexcept
       {
-	if constexpr (sizeof...(_Args) != 0)
+	const _CharT __braces[2] = { _CharT('{'), _CharT('}') };
+	size_t __count = 0;
+	size_t __n;
+	// A recorded literal can end with the first brace of an escape.
+	while ((__n = __str.find_first_of(__braces, 0, 2)) != __str.npos
+		 && __n + 2 <= __str.size())
 	  {
-	    if (__id < sizeof...(_Args))
-	      {
-		_M_parse_format_spec<_Args...>(__id);
-		return;
-	      }
+	    __str.remove_prefix(__n + 2);
+	    ++__count;
 	  }
-	__builtin_unreachable();
+	return __count;
       }
 
-      template<typename _Tp, typename... _OtherArgs>
-	constexpr void
-	_M_parse_format_spec(size_t __id)
+      // The length of the output of _M_format_builtin(__arg, __spec), or
+      // size_t(-1) if it cannot be computed without formatting, because it
+      // depends on the locale or on the digits of a floating-point value.
+      template<typename _Tp>
+	size_t
+	_M_measure_arg(_Tp __arg, const _Spec<_CharT>& __spec)
 	{
-	  if (__id == 0)
+	  if (__spec._M_localized)
+	    return -1;
+
+	  size_t __len;
+	  if constexpr (is_same_v<_Tp, _CharT>)
 	    {
-	      formatter<_Tp, _CharT> __f;
-	      this->_M_pc.advance_to(__f.parse(this->_M_pc));
+	      if (__spec._M_type != _Pres_none && __spec._M_type != _Pres_c)
+		return -1;
+	      __len = 1;
+	    }
+	  else if constexpr (is_same_v<_Tp, bool>)
+	    {
+	      if (__spec._M_type != _Pres_s)
+		return _M_measure_arg(static_cast<unsigned>(__arg), __spec);
+	      __len = __arg ? 4 : 5;
+	    }
+	  else if constexpr (__is_one_of<_Tp, const _CharT*,
+					  basic_string_view<_CharT>>::value)
+	    {
+	      __len = basic_string_view<_CharT>(__arg).size();
+	      if (__spec._M_prec_kind != _WP_none)
+		__len = std::min(__len, __spec._M_get_precision(_M_fc));
+	    }
+	  else if constexpr (is_same_v<_Tp, const void*>)
+	    {
+	      auto __u = reinterpret_cast<__UINTPTR_TYPE__>(__arg);
+	      const unsigned __bits = CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_len_2(__u);
+	      __len = 2 + std::max((__bits + 3) / 4, 1u);
+	    }
+	  else if constexpr (is_integral_v<_Tp>)
+	    {
+	      if (__spec._M_type == _Pres_c)
+		return -1;
+
+	      __unsigned_digits_t<_Tp> __u = __arg;
+	      if (__arg < 0)
+		__u = -__u;
+	      const unsigned __bits = CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_len_2(__u);
+	      __len = __arg < 0 || __spec._M_sign == _Sign_plus
+			|| __spec._M_sign == _Sign_space;
+	      switch (__spec._M_type)
+		{
+		case _Pres_b:
+		case _Pres_B:
+		  __len += std::max(__bits, 1u) + 2 * __spec._M_alt;
+		  break;
+		case _Pres_o:
+		  __len += std::max((__bits + 2) / 3, 1u)
+			     + (__spec._M_alt && __u != 0);
+		  break;
+		case _Pres_x:
+		case _Pres_X:
+		  __len += std::max((__bits + 3) / 4, 1u) + 2 * __spec._M_alt;
+		  break;
+		default:
+		  {
+		    const unsigned __digits = CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_len(__u);
+		    __len += __digits;
+		    if (__spec._M_group != _Group_none)
+		      __len += (__digits - 1) / 3;
+		  }
+		}
 	    }
-	  else if constexpr (sizeof...(_OtherArgs) != 0)
-	    _M_parse_format_spec<_OtherArgs...>(__id - 1);
 	  else
-	    __builtin_unreachable();
+	    return -1;
+	  return std::max(__len, __spec._M_get_width(_M_fc));
 	}
-    };
 
-  template<typename _Out, typename _CharT, typename _Context>
-    inline _Out
-    __do_vformat_to(_Out __out, basic_string_view<_CharT> __fmt,
-		    const basic_format_args<_Context>& __args,
-		    const locale* __loc)
-    {
-      _Iter_sink<_CharT, _Out> __sink(std::move(__out));
-      _Sink_iter<_CharT> __sink_out;
+      // Write literal text, replacing escape sequences "{{" and "}}".
+      void
+      _M_write_literal(basic_string_view<_CharT> __str, bool __esc)
+      {
+	if (__esc)
+	  {
+	    const _CharT __braces[2] = { _CharT('{'), _CharT('}') };
+	    size_t __n;
+	    while ((__n = __str.find_first_of(__braces, 0, 2)) != __str.npos)
+	      {
+		_M_fc.advance_to(CXX20_FORMAT_DECORATE_NAME(__format)::__write(_M_fc.out(),
+						     __str.substr(0, __n + 1)));
+		__str.remove_prefix(std::min(__n + 2, __str.size()));
+	      }
+	  }
+	_M_fc.advance_to(CXX20_FORMAT_DECORATE_NAME(__format)::__write(_M_fc.out(), __str));
+      }
 
-      if constexpr (is_same_v<_Out, _Sink_iter<_CharT>>)
-	__sink_out = __out; // Already a sink iterator, safe to use post-move.
-      else
-	__sink_out = __sink.out();
+      // Format an argument for a replacement field that was recorded.
+      void
+      _M_format_arg(const _Field<_CharT>& __field)
+      {
+	std::visit_format_arg([this, &__field](auto& __arg) {
+	  using _Type = remove_reference_t<decltype(__arg)>;
+	  if constexpr (is_void_v<__builtin_formatter_t<_Type, _CharT>>)
+	    CXX20_FORMAT_DECORATE_NAME(__format)::__invalid_arg_id_in_format_string();
+	  else if (!__field._M_no_spec || !_M_format_default(__arg))
+	    _M_format_builtin(__arg, __field._M_spec);
+	}, _M_fc.arg(__field._M_id));
+      }
 
-      auto __ctx = __loc == nullptr
+      // Write the default representation of an argument for a replacement
+      // field with no format-spec, without going through its formatter.
+      // Returns false if the formatter has to be used.
+      template<typename _Tp>
+	bool
+	_M_format_default(_Tp __arg)
+	{
+	  basic_string_view<_CharT> __str;
+	  char __buf[128];
+	  if constexpr (is_same_v<_Tp, _CharT>)
+	    __str = {&__arg, 1};
+	  else if constexpr (is_same_v<_Tp, bool>)
+	    {
+	      if constexpr (is_same_v<_CharT, char>)
+		__str = __arg ? "true" : "false";
+	      else
+		__str = __arg ? L"true" : L"false";
+	    }
+	  else if constexpr (__is_one_of<_Tp, const _CharT*,
+					  basic_string_view<_CharT>>::value)
+	    __str = __arg;
+	  else if constexpr (!is_same_v<_CharT, char>)
+	    return false; // Digits are widened using the context's locale.
+	  else if constexpr (__is_one_of<_Tp, int, unsigned, long long,
+					  unsigned long long>::value)
+	    {
+	      // Write the digits in place.
+	      make_unsigned_t<_Tp> __u = __arg;
+	      bool __neg = false;
+	      if constexpr (is_signed_v<_Tp>)
+		if (__arg < 0)
+		  {
+		    __neg = true;
+		    __u = -__u;
+		  }
+	      const unsigned __len = CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_len(__u);
+	      basic_format_reservation<_CharT> __r(_M_fc, __neg + __len);
+	      char* __p = __r.data();
+	      if (__neg)
+		*__p++ = '-';
+	      CXX20_FORMAT_DECORATE_NAME(__detail)::__to_chars_10_impl(__p, __len, __u);
+	      __r.commit(__neg + __len);
+	      return true;
+	    }
+	  else if constexpr (__formattable_float<_Tp>)
+	    {
+	      // Shortest representation, as for presentation type none,
+	      // written in place.
+	      basic_format_reservation<_CharT> __r(_M_fc, sizeof(__buf));
+	      auto __res = CXX20_FORMAT_DECORATE_NAME(__format)::CXX20_FORMAT_DECORATE_NAME(__to_chars)(__r.data(), __r.data() + __r.size(), __arg);
+	      if (__res.ec != errc{}) [[unlikely]]
+		return false;
+	      __r.commit(__res.ptr - __r.data());
+	      return true;
+	    }
+	  else
+	    return false;
+	  _M_fc.advance_to(CXX20_FORMAT_DECORATE_NAME(__format)::__write(_M_fc.out(), __str));
+	  return true;
+	}
+
+      // Format an argument using the library's formatter for its type.
+      template<typename _Tp>
+	void
+	_M_format_builtin(_Tp __arg, const _Spec<_CharT>& __spec)
+	{
+	  __builtin_formatter_t<_Tp, _CharT> __f;
+	  __f._M_spec = __spec;
+	  if constexpr (is_same_v<_Tp, _CharT>)
+	    {
+	      // Same as std::formatter<_CharT, _CharT>::format.
+	      if (__spec._M_type == _Pres_none)
+		_M_fc.advance_to(__f._M_format_character(__arg, _M_fc));
+	      else if (__spec._M_type != _Pres_esc)
+		_M_fc.advance_to(__f.format(__arg, _M_fc));
+	    }
+	  else
+	    _M_fc.advance_to(__f.format(__arg, _M_fc));
+	}
+    };
+
+  // Validate a format string for Args, recording its fields in a _Store.
+  template<typename _CharT, typename _Store, typename... _Args>
+    class _Checking_scanner
+    : public _Scanner<_CharT, _Checking_scanner<_CharT, _Store, _Args...>>
+    {
+      using _Base = _Scanner<_CharT, _Checking_scanner>;
+      friend _Base;
+
+      static_assert(
+	(is_default_constructible_v<formatter<remove_const_t<__unnamed_arg_t<_Args>>,
+					      _CharT>> && ...),
+	"std::formatter must be specialized for each type being formatted");
+
+      using iterator = typename _Base::iterator;
+      using _Context = basic_format_context<_Sink_iter<_CharT>, _CharT>;
+
+    public:
+      constexpr
+      _Checking_scanner(basic_string_view<_CharT> __str)
+      : _Base(__str, sizeof...(_Args)), _M_first(__str.begin())
+      {
+	_M_fields._M_valid
+	  = __str.size() <= __gnu_cxx::__int_traits<unsigned short>::__max;
+      }
+
+      // The replacement fields found by _M_scan().
+      _Store _M_fields;
+
+      // An upper bound of the length of the output, or size_t(-1).
+      size_t _M_max_size = 0;
+
+    private:
+      iterator _M_first;
+
+      constexpr void
+      _M_add_max_size(size_t __n) noexcept
+      {
+	if (__builtin_add_overflow(_M_max_size, __n, &_M_max_size))
+	  _M_max_size = __gnu_cxx::__int_traits<size_t>::__max;
+      }
+
+      // Record literal text as preceding the next replacement field.
+      constexpr void
+      _M_on_chars(iterator __last)
+      {
+	_M_add_max_size(__last - this->begin());
+	if (!_M_fields._M_valid || this->begin() == __last)
+	  return;
+	_M_fields._M_back()._M_add_literal(this->begin() - _M_first,
+					   __last - _M_first);
+      }
+
+      constexpr void
+      _M_format_arg(size_t __id)
+      {
+	if constexpr (sizeof...(_Args) != 0)
+	  {
+	    if (__id < sizeof...(_Args))
+	      {
+		_M_parse_format_spec<_Args...>(__id);
+		if (_M_fields._M_valid)
+		  {
+		    _M_fields._M_back()._M_id = __id;
+		    _M_fields._M_push();
+		  }
+		return;
+	      }
+	  }
+	// The parse context only checks arg-ids during constant evaluation,
+	// so a format string compiled at runtime is checked here.
+	CXX20_FORMAT_DECORATE_NAME(__format)::__invalid_arg_id_in_format_string();
+      }
+
+      // Resolve a named argument to its index.
+      constexpr size_t
+      _M_named_arg_id(basic_string_view<_CharT> __name)
+      {
+	const basic_string_view<_CharT> __names[] = {
+	  CXX20_FORMAT_DECORATE_NAME(__format)::__arg_name<_Args, _CharT>()..., {}
+	};
+	for (size_t __id = 0; __id != sizeof...(_Args); ++__id)
+	  if (__names[__id] == __name)
+	    return __id;
+	CXX20_FORMAT_DECORATE_NAME(__format)::__invalid_arg_id_in_format_string();
+      }
+
+      template<typename _Tp, typename... _OtherArgs>
+	constexpr void
+	_M_parse_format_spec(size_t __id)
+	{
+	  if (__id == 0)
+	    {
+	      // Use the formatter that std::formatter<_Tp, _CharT> uses, so
+	      // that the parsed format-spec can be recorded.
+	      using _Tv = remove_const_t<__unnamed_arg_t<_Tp>>;
+	      using _Td
+		= typename basic_format_arg<_Context>::template _Normalize<_Tv>;
+	      using _Formatter = __builtin_formatter_t<_Td, _CharT>;
+	      if constexpr (is_void_v<_Formatter>)
+		{
+		  formatter<_Tv, _CharT> __f;
+		  this->_M_pc.advance_to(__f.parse(this->_M_pc));
+		  _M_fields._M_valid = false;
+		  _M_add_max_size(__gnu_cxx::__int_traits<size_t>::__max);
+		}
+	      else
+		{
+		  const bool __no_spec = *this->begin() == '}';
+		  auto __spec = CXX20_FORMAT_DECORATE_NAME(__format)::__parse_builtin_spec<_Td>(this->_M_pc);
+		  _M_add_max_size(CXX20_FORMAT_DECORATE_NAME(__format)::__max_formatted_size<_Td>(__spec));
+		  if (_M_fields._M_valid)
+		    {
+		      _M_fields._M_back()._M_spec = __spec;
+		      _M_fields._M_back()._M_no_spec = __no_spec;
+		    }
+		}
+	    }
+	  else if constexpr (sizeof...(_OtherArgs) != 0)
+	    _M_parse_format_spec<_OtherArgs...>(__id - 1);
+	  else
+	    __builtin_unreachable();
+	}
+    };
+
+  // Append the output to a string or vector, using its spare capacity.
+  // The sink writes into __seq where it is, rather than taking it over, so
+  // __seq keeps its contents even if the sink's constructor throws.
+  template<typename _Seq, typename _CharT, typename _Context>
+    inline void
+    __vformat_append(_Seq& __seq, _Field_span<_CharT> __fmt,
+		     const basic_format_args<_Context>& __args,
+		     const locale* __loc = nullptr)
+    {
+      _Seq_append_sink<_Seq> __sink(__seq);
+      // Trim the sequence to the output even if formatting throws, keeping
+      // its previous contents and the output written so far.
+      struct _Guard
+      {
+	_Seq_append_sink<_Seq>& _M_sink;
+	~_Guard() { _M_sink._M_finish(); }
+      } __guard{__sink};
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(__sink.out(), __fmt, __args, __loc);
+    }
+
+  template<typename _Out, typename _CharT, typename _Context>
+    inline _Out
+    __do_vformat_to(_Out __out, _Field_span<_CharT> __fmt,
+		    const basic_format_args<_Context>& __args,
+		    const locale* __loc, pmr::memory_resource* __mr)
+    {
+      // Append to a string or vector in bulk, instead of one character at a
+      // time through the iterator.
+      if constexpr (__is_specialization_of<_Out, back_insert_iterator>)
+	{
+	  using _Seq = typename _Out::container_type;
+	  if constexpr ((__is_specialization_of<_Seq, basic_string>
+			   || __is_specialization_of<_Seq, vector>)
+			  && is_same_v<typename _Seq::value_type, _CharT>)
+	    {
+	      // The standard specifies back_insert_iterator::container as a
+	      // protected member (not an exposition-only one), so a derived
+	      // class may name it; there is no public accessor.
+	      struct _Access : _Out { using _Out::container; };
+	      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_append(*(__out.*&_Access::container), __fmt,
+					      __args, __loc);
+	      return __out;
+	    }
+	}
+
+      _Iter_sink<_CharT, _Out> __sink(std::move(__out));
+      _Sink_iter<_CharT> __sink_out;
+
+      if constexpr (is_same_v<_Out, _Sink_iter<_CharT>>)
+	__sink_out = __out; // Already a sink iterator, safe to use post-move.
+      else
+	__sink_out = __sink.out();
+
+      auto __ctx = __loc == nullptr
 		     ? _Context(__args, __sink_out)
 		     : _Context(__args, __sink_out, *__loc);
-      _Formatting_scanner<_Sink_iter<_CharT>, _CharT> __scanner(__ctx, __fmt);
-      __scanner._M_scan();
+      __ctx._M_mr = __mr;
+      _Formatting_scanner<_Sink_iter<_CharT>, _CharT> __scanner(__ctx,
+								__fmt._M_str);
+      if (__fmt._M_fields)
+	__scanner._M_replay(__fmt);
+      else if (const auto __types = __args._M_packed_types())
+	{
+	  // Not checked at compile-time, look for the string in the cache.
+	  auto& __cache = _Field_cache<_CharT>::_S_get();
+	  if (auto __found = __cache._M_find(__fmt._M_str, __types))
+	    __scanner._M_replay(__found->_M_span(__fmt._M_str));
+	  else
+	    {
+	      typename _Field_cache<_CharT>::_Store __fields;
+	      __scanner._M_scan(__fields);
+	      if (__fields._M_valid)
+		__cache._M_insert(__fmt._M_str, __types, std::move(__fields));
+	    }
+	}
+      else
+	__scanner._M_scan();
 
       if constexpr (is_same_v<_Out, _Sink_iter<_CharT>>)
 	return __ctx.out();
@@ -3653,6 +5464,55 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	return std::move(__sink)._M_finish().out;
     }
 
+  template<typename _Out, typename _CharT, typename _Context>
+    [[__gnu__::__always_inline__]]
+    inline _Out
+    __do_vformat_to(_Out __out, basic_string_view<_CharT> __fmt,
+		    const basic_format_args<_Context>& __args,
+		    const locale* __loc = nullptr)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(std::move(__out),
+				    _Field_span<_CharT>{__fmt}, __args, __loc);
+    }
+
+  template<typename _CharT, typename _Context>
+    inline basic_string<_CharT>
+    __vformat(_Field_span<_CharT> __fmt,
+	      const basic_format_args<_Context>& __args,
+	      const locale* __loc = nullptr)
+    {
+      _Str_sink<_CharT> __buf;
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(__buf.out(), __fmt, __args, __loc);
+      return std::move(__buf).get();
+    }
+
+  // The memory resource that __a allocates from, if it has one.
+  template<typename _Alloc>
+    inline pmr::memory_resource*
+    __memory_resource_of(const _Alloc& __a) noexcept
+    {
+      if constexpr (__is_specialization_of<_Alloc, pmr::polymorphic_allocator>)
+	return __a.resource();
+      else
+	return nullptr;
+    }
+
+  // Format into a string that uses __a. If __a is a polymorphic_allocator
+  // then temporary strings used by the formatters also allocate from its
+  // memory resource.
+  template<typename _CharT, typename _Alloc, typename _Context>
+    inline basic_string<_CharT, char_traits<_CharT>, _Alloc>
+    __vformat(const _Alloc& __a, _Field_span<_CharT> __fmt,
+	      const basic_format_args<_Context>& __args,
+	      const locale* __loc = nullptr)
+    {
+      using _Str = basic_string<_CharT, char_traits<_CharT>, _Alloc>;
+      _Str_sink<_CharT, _Alloc> __buf(_Str{__a});
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(__buf.out(), __fmt, __args, __loc,
+				    CXX20_FORMAT_DECORATE_NAME(__format)::__memory_resource_of(__a));
+      return std::move(__buf).get();
+    }
+
 } // namespace __format
 /// @endcond
 
@@ -3662,13 +5522,619 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       consteval
       basic_format_string<_CharT, _Args...>::
       basic_format_string(const _Tp& __s)
-      : _M_str(__s)
+      : _M_str(__s), _M_fields(), _M_max_size()
       {
-	CXX20_FORMAT_DECORATE_NAME(__format)::_Checking_scanner<_CharT, remove_cvref_t<_Args>...>
+	CXX20_FORMAT_DECORATE_NAME(__format)::_Checking_scanner<_CharT, decltype(_M_fields),
+					    remove_cvref_t<_Args>...>
 	  __scanner(_M_str);
 	__scanner._M_scan();
+	_M_fields = __scanner._M_fields;
+	_M_max_size = __scanner._M_max_size;
+      }
+
+  template<typename _CharT, typename... _Args>
+    constexpr CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<_CharT>
+    basic_format_string<_CharT, _Args...>::
+    _M_get_fields() const noexcept
+    { return _M_fields._M_span(_M_str); }
+
+  template<typename _CharT>
+    template<typename _Context>
+      inline CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<_CharT>
+      basic_compiled_format<_CharT>::
+      _M_get_fields(const basic_format_args<_Context>& __args) const noexcept
+      {
+	// The specs were only checked against the types the string was
+	// compiled for, so replay them only if __args has the same types.
+	// Otherwise scan the string again, checking it against __args.
+	if (_M_num_args == 0
+	      || (_M_arg_types != 0 && __args._M_packed_types() == _M_arg_types))
+	  return _M_fields._M_span(_M_str);
+	return {_M_str};
+      }
+
+  template<typename _CharT>
+    template<typename... _Args>
+      basic_compiled_format<_CharT>
+      basic_compiled_format<_CharT>::
+      _S_compile(basic_string_view<_CharT> __str)
+      {
+	basic_compiled_format __fmt;
+	__fmt._M_str = __str;
+	CXX20_FORMAT_DECORATE_NAME(__format)::_Checking_scanner<_CharT, decltype(_M_fields), _Args...>
+	  __scanner(__fmt._M_str);
+	__scanner._M_scan();
+	__fmt._M_fields = std::move(__scanner._M_fields);
+	using _Context = basic_format_context<
+	  CXX20_FORMAT_DECORATE_NAME(__format)::_Sink_iter<_CharT>, _CharT>;
+	__fmt._M_num_args = sizeof...(_Args);
+	__fmt._M_arg_types
+	  = basic_format_args<_Context>::template _S_packed_types_of<_Args...>();
+	return __fmt;
+      }
+
+  /** Check and parse a format string for the specified argument types.
+   *
+   * @throw format_error if the string is not a valid format string for
+   * arguments of types `_Args...`.
+   */
+  template<typename... _Args>
+    [[nodiscard]]
+    inline compiled_format
+    make_compiled_format(string_view __fmt)
+    { return compiled_format::_S_compile<remove_cvref_t<_Args>...>(__fmt); }
+
+  template<typename... _Args>
+    [[nodiscard]]
+    inline wcompiled_format
+    make_wcompiled_format(wstring_view __fmt)
+    { return wcompiled_format::_S_compile<remove_cvref_t<_Args>...>(__fmt); }
+
+/// @cond undocumented
+namespace CXX20_FORMAT_DECORATE_NAME(__format)
+{
+  // A sink that writes directly into the storage of a basic_memory_buffer,
+  // after its current contents. The buffer grows geometrically when the span
+  // fills up, and its size is updated by _M_finish().
+  template<typename _Buffer>
+    class _Memory_buffer_sink : public _Sink<typename _Buffer::value_type>
+    {
+      using _CharT = typename _Buffer::value_type;
+
+      _Buffer& _M_buf;
+
+      // Use the capacity after the first __used characters as the span.
+      void
+      _M_use_capacity(size_t __used)
+      {
+	if (__used == _M_buf._M_cap)
+	  _M_buf._M_grow(__used + 1, __used);
+	span<_CharT> __s(_M_buf._M_ptr, _M_buf._M_cap);
+	this->_M_reset(__s, __s.begin() + __used);
+      }
+
+      void
+      _M_overflow() override
+      { _M_use_capacity(this->_M_used().size()); }
+
+    public:
+      // The span is empty until the body sets it to the buffer's capacity.
+      explicit
+      _Memory_buffer_sink(_Buffer& __buf)
+      : _Sink<_CharT>(span<_CharT>()), _M_buf(__buf)
+      { _M_use_capacity(__buf.size()); }
+
+      using _Sink<_CharT>::out;
+
+      void
+      _M_finish() noexcept
+      { _M_buf._M_size = this->_M_used().size(); }
+    };
+} // namespace __format
+/// @endcond
+
+  /** A contiguous buffer of characters that stores up to `_InlineN`
+   * characters in the object itself, and only allocates for longer contents.
+   *
+   * `std::format_to(__buf, __fmt, __args...)` appends the output to the
+   * buffer, writing it directly into the buffer's storage.
+   *
+   * This is an extension.
+   */
+  template<typename _CharT, size_t _InlineN = 500,
+	   typename _Alloc = allocator<_CharT>>
+    class basic_memory_buffer
+    {
+      static_assert(_InlineN != 0);
+      static_assert(is_same_v<typename _Alloc::value_type, _CharT>);
+
+      using _Alloc_traits = allocator_traits<_Alloc>;
+
+      template<typename _Buffer>
+	friend class CXX20_FORMAT_DECORATE_NAME(__format)::_Memory_buffer_sink;
+
+    public:
+      using value_type = _CharT;
+      using allocator_type = _Alloc;
+      using size_type = size_t;
+      using difference_type = ptrdiff_t;
+      using reference = _CharT&;
+      using const_reference = const _CharT&;
+      using iterator = _CharT*;
+      using const_iterator = const _CharT*;
+
+      basic_memory_buffer() noexcept(is_nothrow_default_constructible_v<_Alloc>)
+      : _M_alloc()
+      { }
+
+      explicit
+      basic_memory_buffer(const _Alloc& __a) noexcept
+      : _M_alloc(__a)
+      { }
+
+      basic_memory_buffer(basic_memory_buffer&& __other) noexcept
+      : _M_alloc(std::move(__other._M_alloc))
+      { _M_take(__other); }
+
+      basic_memory_buffer&
+      operator=(basic_memory_buffer&& __other)
+      noexcept(_Alloc_traits::propagate_on_container_move_assignment::value
+		 || _Alloc_traits::is_always_equal::value)
+      {
+	if (this != &__other)
+	  {
+	    _M_deallocate();
+	    _M_ptr = _M_inline;
+	    _M_cap = _InlineN;
+	    if constexpr (_Alloc_traits::propagate_on_container_move_assignment::value)
+	      _M_alloc = std::move(__other._M_alloc);
+	    else if constexpr (!_Alloc_traits::is_always_equal::value)
+	      if (__other._M_ptr != __other._M_inline
+		    && _M_alloc != __other._M_alloc)
+		{
+		  // Cannot take the other buffer's storage.
+		  _M_size = 0;
+		  append(__other);
+		  __other.clear();
+		  return *this;
+		}
+	    _M_take(__other);
+	  }
+	return *this;
+      }
+
+      ~basic_memory_buffer()
+      { _M_deallocate(); }
+
+      [[nodiscard]]
+      allocator_type
+      get_allocator() const noexcept
+      { return _M_alloc; }
+
+      [[nodiscard]] size_type size() const noexcept { return _M_size; }
+      [[nodiscard]] size_type capacity() const noexcept { return _M_cap; }
+      [[nodiscard]] bool empty() const noexcept { return _M_size == 0; }
+
+      [[nodiscard]] _CharT* data() noexcept { return _M_ptr; }
+      [[nodiscard]] const _CharT* data() const noexcept { return _M_ptr; }
+
+      [[nodiscard]] iterator begin() noexcept { return _M_ptr; }
+      [[nodiscard]] const_iterator begin() const noexcept { return _M_ptr; }
+      [[nodiscard]] iterator end() noexcept { return _M_ptr + _M_size; }
+      [[nodiscard]] const_iterator end() const noexcept
+      { return _M_ptr + _M_size; }
+
+      [[nodiscard]]
+      reference
+      operator[](size_type __i) noexcept
+      { return _M_ptr[__i]; }
+
+      [[nodiscard]]
+      const_reference
+      operator[](size_type __i) const noexcept
+      { return _M_ptr[__i]; }
+
+      [[nodiscard]]
+      operator basic_string_view<_CharT>() const noexcept
+      { return {_M_ptr, _M_size}; }
+
+      void
+      clear() noexcept
+      { _M_size = 0; }
+
+      void
+      reserve(size_type __n)
+      {
+	if (__n > _M_cap)
+	  _M_grow(__n, _M_size);
+      }
+
+      void
+      resize(size_type __n)
+      {
+	reserve(__n);
+	if (__n > _M_size)
+	  char_traits<_CharT>::assign(_M_ptr + _M_size, __n - _M_size, _CharT());
+	_M_size = __n;
+      }
+
+      void
+      push_back(_CharT __c)
+      {
+	if (_M_size == _M_cap)
+	  _M_grow(_M_size + 1, _M_size);
+	_M_ptr[_M_size++] = __c;
+      }
+
+      void
+      append(basic_string_view<_CharT> __s)
+      {
+	reserve(_M_size + __s.size());
+	char_traits<_CharT>::copy(_M_ptr + _M_size, __s.data(), __s.size());
+	_M_size += __s.size();
+      }
+
+    private:
+      _CharT* _M_ptr = _M_inline;
+      size_t _M_size = 0;
+      size_t _M_cap = _InlineN;
+      [[no_unique_address]] _Alloc _M_alloc;
+      _CharT _M_inline[_InlineN];
+
+      // Reallocate to hold at least __n characters, keeping the first __keep.
+      void
+      _M_grow(size_t __n, size_t __keep)
+      {
+	__n = std::max(__n, 2 * _M_cap);
+	_CharT* __p = _Alloc_traits::allocate(_M_alloc, __n);
+	char_traits<_CharT>::copy(__p, _M_ptr, __keep);
+	_M_deallocate();
+	_M_ptr = __p;
+	_M_cap = __n;
+      }
+
+      void
+      _M_deallocate() noexcept
+      {
+	if (_M_ptr != _M_inline)
+	  _Alloc_traits::deallocate(_M_alloc, _M_ptr, _M_cap);
+      }
+
+      // Take the contents of __other, which must use an equal allocator.
+      void
+      _M_take(basic_memory_buffer& __other) noexcept
+      {
+	if (__other._M_ptr == __other._M_inline)
+	  char_traits<_CharT>::copy(_M_inline, __other._M_inline,
+				    __other._M_size);
+	else
+	  {
+	    _M_ptr = __other._M_ptr;
+	    _M_cap = __other._M_cap;
+	    __other._M_ptr = __other._M_inline;
+	    __other._M_cap = _InlineN;
+	  }
+	_M_size = __other._M_size;
+	__other._M_size = 0;
+      }
+    };
+
+  using memory_buffer = basic_memory_buffer<char>;
+  using wmemory_buffer = basic_memory_buffer<wchar_t>;
+
+/// @cond undocumented
+namespace CXX20_FORMAT_DECORATE_NAME(__format)
+{
+  template<typename _Buffer, typename _CharT, typename _Context>
+    inline void
+    __vformat_to_buffer(_Buffer& __buf, _Field_span<_CharT> __fmt,
+			const basic_format_args<_Context>& __args)
+    {
+      _Memory_buffer_sink<_Buffer> __sink(__buf);
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(__sink.out(), __fmt, __args);
+      __sink._M_finish();
+    }
+
+  template<typename _CharT>
+    class _Ring_sink;
+} // namespace __format
+/// @endcond
+
+  /** A bounded ring buffer of formatted records, written by any number of
+   * threads and read by a single consumer thread.
+   *
+   * `std::format_to(__ring, __fmt, __args...)` claims space in the ring
+   * without locking, formats directly into it and then publishes the record.
+   * Records are delivered to `consume` in the order their space was claimed.
+   * A record that does not fit into its claim is grown in place, or moved to
+   * a new claim, and may be truncated if it needs more than half of the ring.
+   * While the ring is full, `format_to` waits for the consumer to release
+   * space.
+   *
+   * This is an extension.
+   */
+  template<typename _CharT>
+    class basic_format_ring
+    {
+      friend class CXX20_FORMAT_DECORATE_NAME(__format)::_Ring_sink<_CharT>;
+
+      // Space is claimed in slots of this many characters. A record uses
+      // one or more consecutive slots and starts at the start of a slot.
+      static constexpr size_t _S_slot_size = 64 / sizeof(_CharT);
+
+      static constexpr size_t _S_padding = size_t(-1);
+
+      // Describes the record starting in a slot. _M_slots is zero until the
+      // record is published. _M_size is _S_padding for unused slots.
+      struct _Header
+      {
+	size_t _M_size;
+	atomic<size_t> _M_slots{0};
+      };
+
+    public:
+      using value_type = _CharT;
+      using size_type = size_t;
+
+      // The capacity is rounded up to a power of two number of slots.
+      explicit
+      basic_format_ring(size_t __capacity)
+      : _M_nslots(std::__bit_ceil(std::max<size_t>(
+		    (__capacity + _S_slot_size - 1) / _S_slot_size, 2))),
+	_M_text(new _CharT[_M_nslots * _S_slot_size]),
+	_M_headers(new _Header[_M_nslots])
+      { }
+
+      basic_format_ring(const basic_format_ring&) = delete;
+      basic_format_ring& operator=(const basic_format_ring&) = delete;
+
+      size_t
+      capacity() const noexcept
+      { return _M_nslots * _S_slot_size; }
+
+      // Pass each published record to __f as a basic_string_view<_CharT>,
+      // in order, and release its space. Stops at the first record that is
+      // still being written. Only one thread may consume at a time.
+      // If __f throws, that record is delivered again by the next call.
+      // Returns the number of records consumed.
+      template<typename _Func>
+	size_t
+	consume(_Func&& __f)
+	{
+	  size_t __n = 0;
+	  size_t __head = _M_head.load(memory_order_relaxed);
+	  // Wake producers waiting for space if any records were released,
+	  // even if __f throws.
+	  struct _Guard
+	  {
+	    basic_format_ring* _M_ring;
+	    const size_t& _M_pos;
+	    const size_t _M_start;
+	    ~_Guard()
+	    {
+	      if (_M_pos != _M_start)
+		_M_ring->_M_head.notify_all();
+	    }
+	  } __guard{this, __head, __head};
+	  for (;;)
+	    {
+	      const size_t __i = __head & (_M_nslots - 1);
+	      _Header& __h = _M_headers[__i];
+	      const size_t __slots = __h._M_slots.load(memory_order_acquire);
+	      if (__slots == 0)
+		break;
+	      if (__h._M_size != _S_padding)
+		{
+		  __f(basic_string_view<_CharT>(&_M_text[__i * _S_slot_size],
+						__h._M_size));
+		  ++__n;
+		}
+	      __h._M_slots.store(0, memory_order_relaxed);
+	      __head += __slots;
+	      _M_head.store(__head, memory_order_release);
+	    }
+	  return __n;
+	}
+
+    private:
+      // Claim __n consecutive slots and return the first one, waiting for
+      // the consumer to release space if necessary. If the slots would wrap
+      // around the end of the ring, the slots before the end are published
+      // as padding and the claim starts at the beginning.
+      // Precondition: __n <= _M_nslots / 2, so any claim fits an empty ring.
+      // Returns _S_padding if __wait is false and there is not enough space.
+      size_t
+      _M_claim(size_t __n, bool __wait)
+      {
+	size_t __tail = _M_tail.load(memory_order_relaxed);
+	for (;;)
+	  {
+	    const size_t __i = __tail & (_M_nslots - 1);
+	    const size_t __pad = __i + __n > _M_nslots ? _M_nslots - __i : 0;
+	    const size_t __head = _M_head.load(memory_order_acquire);
+	    if (__tail + __pad + __n - __head > _M_nslots)
+	      {
+		if (!__wait)
+		  return _S_padding;
+		_M_head.wait(__head, memory_order_acquire);
+		__tail = _M_tail.load(memory_order_relaxed);
+	      }
+	    else if (_M_tail.compare_exchange_weak(__tail, __tail + __pad + __n,
+						   memory_order_relaxed))
+	      {
+		if (__pad)
+		  _M_publish(__tail, __pad, _S_padding);
+		return __tail + __pad;
+	      }
+	  }
+      }
+
+      // Extend the claim of __n slots at __pos by __more slots, if no other
+      // claim follows it and the slots are free and do not wrap around.
+      bool
+      _M_try_extend(size_t __pos, size_t __n, size_t __more) noexcept
+      {
+	if ((__pos & (_M_nslots - 1)) + __n + __more > _M_nslots)
+	  return false;
+	size_t __end = __pos + __n;
+	if (__end + __more - _M_head.load(memory_order_acquire) > _M_nslots)
+	  return false;
+	return _M_tail.compare_exchange_strong(__end, __end + __more,
+					       memory_order_relaxed);
+      }
+
+      // Make a record of __size characters in the __n slots at __pos
+      // visible to the consumer.
+      void
+      _M_publish(size_t __pos, size_t __n, size_t __size) noexcept
+      {
+	_Header& __h = _M_headers[__pos & (_M_nslots - 1)];
+	__h._M_size = __size;
+	__h._M_slots.store(__n, memory_order_release);
+      }
+
+      span<_CharT>
+      _M_text_of(size_t __pos, size_t __n) const noexcept
+      {
+	return span<_CharT>(&_M_text[(__pos & (_M_nslots - 1)) * _S_slot_size],
+			    __n * _S_slot_size);
+      }
+
+      const size_t _M_nslots;
+      const unique_ptr<_CharT[]> _M_text;
+      const unique_ptr<_Header[]> _M_headers;
+      // The next slot to claim, and the first slot not yet released.
+      // These only increase, and are kept apart to avoid false sharing.
+      alignas(64) atomic<size_t> _M_tail{0};
+      alignas(64) atomic<size_t> _M_head{0};
+    };
+
+  using format_ring = basic_format_ring<char>;
+  using wformat_ring = basic_format_ring<wchar_t>;
+
+/// @cond undocumented
+namespace CXX20_FORMAT_DECORATE_NAME(__format)
+{
+  // A sink that writes into a claim in a basic_format_ring. When the claim
+  // is full it is extended in place if possible, otherwise the output so far
+  // is moved to a claim twice as large. If neither is possible without
+  // waiting, the claim is released as padding and the output is collected
+  // in a string instead, to be copied into a new claim by _M_finish().
+  // Waiting for space only while holding no claim means that producers
+  // can never wait for each other. A record that is copied into a new claim
+  // is truncated to half of the ring, so that the claim can be satisfied.
+  template<typename _CharT>
+    class _Ring_sink final : public _Sink<_CharT>
+    {
+      using _Ring = basic_format_ring<_CharT>;
+
+      _Ring& _M_ring;
+      size_t _M_pos = 0;
+      size_t _M_slots;
+      basic_string<_CharT> _M_str; // The output, once it is not in the ring.
+      _CharT _M_buf[_Ring::_S_slot_size];
+
+      void
+      _M_use_claim(size_t __used)
+      {
+	span<_CharT> __s = _M_ring._M_text_of(_M_pos, _M_slots);
+	this->_M_reset(__s, __s.begin() + __used);
+      }
+
+      void
+      _M_overflow() override
+      {
+	auto __used = this->_M_used();
+	if (_M_slots == 0)
+	  _M_str.append(__used.data(), __used.size());
+	else
+	  {
+	    for (size_t __more : { _M_slots, size_t(1) })
+	      if (_M_ring._M_try_extend(_M_pos, _M_slots, __more))
+		{
+		  _M_slots += __more;
+		  return _M_use_claim(__used.size());
+		}
+	    if (2 * _M_slots <= _M_ring._M_nslots / 2)
+	      {
+		const size_t __pos = _M_ring._M_claim(2 * _M_slots, false);
+		if (__pos != _Ring::_S_padding)
+		  {
+		    char_traits<_CharT>::copy(_M_ring._M_text_of(__pos, 1).data(),
+					      __used.data(), __used.size());
+		    _M_ring._M_publish(_M_pos, _M_slots, _Ring::_S_padding);
+		    _M_pos = __pos;
+		    _M_slots *= 2;
+		    return _M_use_claim(__used.size());
+		  }
+	      }
+	    _M_str.assign(__used.data(), __used.size());
+	    _M_ring._M_publish(_M_pos, _M_slots, _Ring::_S_padding);
+	    _M_slots = 0;
+	  }
+	span<_CharT> __buf{_M_buf};
+	this->_M_reset(__buf, __buf.begin());
       }
 
+    public:
+      // Claim enough slots for __size_hint characters, if that fits,
+      // or a single slot if the size of the output is unknown.
+      _Ring_sink(_Ring& __ring, size_t __size_hint)
+      : _Sink<_CharT>(span<_CharT>()), _M_ring(__ring),
+	_M_slots(__size_hint == __gnu_cxx::__int_traits<size_t>::__max ? 1
+		   : std::min(__size_hint / _Ring::_S_slot_size + 1,
+			      __ring._M_nslots / 2))
+      {
+	_M_pos = __ring._M_claim(_M_slots, true);
+	_M_use_claim(0);
+      }
+
+      ~_Ring_sink()
+      {
+	if (_M_slots)
+	  _M_ring._M_publish(_M_pos, _M_slots, _Ring::_S_padding);
+      }
+
+      using _Sink<_CharT>::out;
+
+      // Publish the record. Returns false if it was truncated.
+      bool
+      _M_finish()
+      {
+	auto __used = this->_M_used();
+	if (_M_slots)
+	  {
+	    _M_ring._M_publish(_M_pos, _M_slots, __used.size());
+	    _M_slots = 0;
+	    return true;
+	  }
+	_M_str.append(__used.data(), __used.size());
+	const size_t __max = _M_ring._M_nslots / 2;
+	const size_t __slots = _M_str.size() / _Ring::_S_slot_size + 1;
+	const size_t __size = std::min(_M_str.size(),
+				       __max * _Ring::_S_slot_size);
+	const size_t __pos = _M_ring._M_claim(std::min(__slots, __max), true);
+	char_traits<_CharT>::copy(_M_ring._M_text_of(__pos, 1).data(),
+				  _M_str.data(), __size);
+	_M_ring._M_publish(__pos, std::min(__slots, __max), __size);
+	return __size == _M_str.size();
+      }
+    };
+
+  template<typename _CharT, typename _Context>
+    inline bool
+    __vformat_to_ring(basic_format_ring<_CharT>& __ring,
+		      _Field_span<_CharT> __fmt,
+		      const basic_format_args<_Context>& __args,
+		      size_t __size_hint)
+    {
+      _Ring_sink<_CharT> __sink(__ring, __size_hint);
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(__sink.out(), __fmt, __args);
+      return __sink._M_finish();
+    }
+} // namespace __format
+/// @endcond
+
   // [format.functions], formatting functions
 
   template<typename _Out> requires output_iterator<_Out, const char&>
@@ -3697,53 +6163,228 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 	       wformat_args __args)
     { return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(std::move(__out), __fmt, __args, &__loc); }
 
+  template<typename _Out> requires output_iterator<_Out, const char&>
+    [[__gnu__::__always_inline__]]
+    inline _Out
+    vformat_to(_Out __out, const compiled_format& __fmt, format_args __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(std::move(__out),
+					   __fmt._M_get_fields(__args), __args);
+    }
+
+  template<typename _Out> requires output_iterator<_Out, const wchar_t&>
+    [[__gnu__::__always_inline__]]
+    inline _Out
+    vformat_to(_Out __out, const wcompiled_format& __fmt, wformat_args __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(std::move(__out),
+					   __fmt._M_get_fields(__args), __args);
+    }
+
+  template<typename _Out> requires output_iterator<_Out, const char&>
+    [[__gnu__::__always_inline__]]
+    inline _Out
+    vformat_to(_Out __out, const locale& __loc, const compiled_format& __fmt,
+	       format_args __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(std::move(__out),
+					   __fmt._M_get_fields(__args), __args,
+					   &__loc);
+    }
+
+  template<typename _Out> requires output_iterator<_Out, const wchar_t&>
+    [[__gnu__::__always_inline__]]
+    inline _Out
+    vformat_to(_Out __out, const locale& __loc, const wcompiled_format& __fmt,
+	       wformat_args __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(std::move(__out),
+					   __fmt._M_get_fields(__args), __args,
+					   &__loc);
+    }
+
+  template<size_t _Nm, typename _Alloc>
+    inline back_insert_iterator<basic_memory_buffer<char, _Nm, _Alloc>>
+    vformat_to(basic_memory_buffer<char, _Nm, _Alloc>& __buf, string_view __fmt,
+	       format_args __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_buffer(__buf,
+	CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args);
+      return back_inserter(__buf);
+    }
+
+  template<size_t _Nm, typename _Alloc>
+    inline back_insert_iterator<basic_memory_buffer<wchar_t, _Nm, _Alloc>>
+    vformat_to(basic_memory_buffer<wchar_t, _Nm, _Alloc>& __buf,
+	       wstring_view __fmt, wformat_args __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_buffer(__buf,
+	CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<wchar_t>{__fmt}, __args);
+      return back_inserter(__buf);
+    }
+
+  // Append a record to a basic_format_ring.
+  // Returns false if the record was truncated to fit.
+  inline bool
+  vformat_to(format_ring& __ring, string_view __fmt, format_args __args)
+  {
+    return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_ring(__ring,
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args,
+      __gnu_cxx::__int_traits<size_t>::__max);
+  }
+
+  inline bool
+  vformat_to(wformat_ring& __ring, wstring_view __fmt, wformat_args __args)
+  {
+    return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_ring(__ring,
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<wchar_t>{__fmt}, __args,
+      __gnu_cxx::__int_traits<size_t>::__max);
+  }
+
   [[nodiscard]]
   inline string
   vformat(string_view __fmt, format_args __args)
   {
-    CXX20_FORMAT_DECORATE_NAME(__format)::_Str_sink<char> __buf;
-    std::vformat_to(__buf.out(), __fmt, __args);
-    return std::move(__buf).get();
+    return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(
+	     CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args);
+  }
+
+  [[nodiscard]]
+  inline wstring
+  vformat(wstring_view __fmt, wformat_args __args)
+  {
+    return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(
+	     CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<wchar_t>{__fmt}, __args);
+  }
+
+  [[nodiscard]]
+  inline string
+  vformat(const locale& __loc, string_view __fmt, format_args __args)
+  {
+    return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(
+	     CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args, &__loc);
+  }
+
+  [[nodiscard]]
+  inline wstring
+  vformat(const locale& __loc, wstring_view __fmt, wformat_args __args)
+  {
+    return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(
+	     CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<wchar_t>{__fmt}, __args, &__loc);
+  }
+
+  [[nodiscard]]
+  inline string
+  vformat(const compiled_format& __fmt, format_args __args)
+  { return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__fmt._M_get_fields(__args), __args); }
+
+  [[nodiscard]]
+  inline wstring
+  vformat(const wcompiled_format& __fmt, wformat_args __args)
+  { return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__fmt._M_get_fields(__args), __args); }
+
+  [[nodiscard]]
+  inline string
+  vformat(const locale& __loc, const compiled_format& __fmt,
+	  format_args __args)
+  {
+    return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__fmt._M_get_fields(__args), __args,
+				    &__loc);
+  }
+
+  [[nodiscard]]
+  inline wstring
+  vformat(const locale& __loc, const wcompiled_format& __fmt,
+	  wformat_args __args)
+  {
+    return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__fmt._M_get_fields(__args), __args,
+				    &__loc);
   }
 
-  [[nodiscard]]
-  inline wstring
-  vformat(wstring_view __fmt, wformat_args __args)
-  {
-    CXX20_FORMAT_DECORATE_NAME(__format)::_Str_sink<wchar_t> __buf;
-    std::vformat_to(__buf.out(), __fmt, __args);
-    return std::move(__buf).get();
-  }
+  /** Format into a string that allocates its memory with `__a`.
+   *
+   * If `__a` is a `pmr::polymorphic_allocator` then the temporary strings
+   * that some formatters need are allocated from its memory resource too.
+   *
+   * This is an extension.
+   */
+  template<typename _Alloc>
+    [[nodiscard]]
+    inline basic_string<char, char_traits<char>, _Alloc>
+    vformat(allocator_arg_t, const _Alloc& __a, string_view __fmt,
+	    format_args __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__a,
+	       CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args);
+    }
+
+  template<typename _Alloc>
+    [[nodiscard]]
+    inline basic_string<wchar_t, char_traits<wchar_t>, _Alloc>
+    vformat(allocator_arg_t, const _Alloc& __a, wstring_view __fmt,
+	    wformat_args __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__a,
+	       CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<wchar_t>{__fmt}, __args);
+    }
+
+  template<typename _Alloc>
+    [[nodiscard]]
+    inline basic_string<char, char_traits<char>, _Alloc>
+    vformat(allocator_arg_t, const _Alloc& __a, const locale& __loc,
+	    string_view __fmt, format_args __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__a,
+	       CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args, &__loc);
+    }
 
+  template<typename _Alloc>
+    [[nodiscard]]
+    inline basic_string<wchar_t, char_traits<wchar_t>, _Alloc>
+    vformat(allocator_arg_t, const _Alloc& __a, const locale& __loc,
+	    wstring_view __fmt, wformat_args __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__a,
+	       CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<wchar_t>{__fmt}, __args, &__loc);
+    }
+
+  /** Format into a string that allocates from `__mr`.
+   *
+   * This is an extension.
+   */
   [[nodiscard]]
-  inline string
-  vformat(const locale& __loc, string_view __fmt, format_args __args)
+  inline pmr::string
+  vformat(pmr::memory_resource* __mr, string_view __fmt, format_args __args)
   {
-    CXX20_FORMAT_DECORATE_NAME(__format)::_Str_sink<char> __buf;
-    std::vformat_to(__buf.out(), __loc, __fmt, __args);
-    return std::move(__buf).get();
+    return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(pmr::polymorphic_allocator<char>(__mr),
+	     CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args);
   }
 
   [[nodiscard]]
-  inline wstring
-  vformat(const locale& __loc, wstring_view __fmt, wformat_args __args)
+  inline pmr::wstring
+  vformat(pmr::memory_resource* __mr, wstring_view __fmt, wformat_args __args)
   {
-    CXX20_FORMAT_DECORATE_NAME(__format)::_Str_sink<wchar_t> __buf;
-    std::vformat_to(__buf.out(), __loc, __fmt, __args);
-    return std::move(__buf).get();
+    return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(pmr::polymorphic_allocator<wchar_t>(__mr),
+	     CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<wchar_t>{__fmt}, __args);
   }
 
   template<typename... _Args>
     [[nodiscard]]
     inline string
     format(format_string<_Args...> __fmt, _Args&&... __args)
-    { return std::vformat(__fmt.get(), std::make_format_args(__args...)); }
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__fmt._M_get_fields(),
+			format_args(std::make_format_args(__args...)));
+    }
 
   template<typename... _Args>
     [[nodiscard]]
     inline wstring
     format(wformat_string<_Args...> __fmt, _Args&&... __args)
-    { return std::vformat(__fmt.get(), std::make_wformat_args(__args...)); }
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__fmt._M_get_fields(),
+			wformat_args(std::make_wformat_args(__args...)));
+    }
 
   template<typename... _Args>
     [[nodiscard]]
@@ -3751,8 +6392,8 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     format(const locale& __loc, format_string<_Args...> __fmt,
 	   _Args&&... __args)
     {
-      return std::vformat(__loc, __fmt.get(),
-			  std::make_format_args(__args...));
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__fmt._M_get_fields(),
+			format_args(std::make_format_args(__args...)), &__loc);
     }
 
   template<typename... _Args>
@@ -3761,8 +6402,78 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     format(const locale& __loc, wformat_string<_Args...> __fmt,
 	   _Args&&... __args)
     {
-      return std::vformat(__loc, __fmt.get(),
-			  std::make_wformat_args(__args...));
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__fmt._M_get_fields(),
+			wformat_args(std::make_wformat_args(__args...)), &__loc);
+    }
+
+  /** Format into a string that allocates its memory with `__a`.
+   *
+   * This is an extension.
+   */
+  template<typename _Alloc, typename... _Args>
+    [[nodiscard]]
+    inline basic_string<char, char_traits<char>, _Alloc>
+    format(allocator_arg_t, const _Alloc& __a, format_string<_Args...> __fmt,
+	   _Args&&... __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__a, __fmt._M_get_fields(),
+			format_args(std::make_format_args(__args...)));
+    }
+
+  template<typename _Alloc, typename... _Args>
+    [[nodiscard]]
+    inline basic_string<wchar_t, char_traits<wchar_t>, _Alloc>
+    format(allocator_arg_t, const _Alloc& __a, wformat_string<_Args...> __fmt,
+	   _Args&&... __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__a, __fmt._M_get_fields(),
+			wformat_args(std::make_wformat_args(__args...)));
+    }
+
+  template<typename _Alloc, typename... _Args>
+    [[nodiscard]]
+    inline basic_string<char, char_traits<char>, _Alloc>
+    format(allocator_arg_t, const _Alloc& __a, const locale& __loc,
+	   format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__a, __fmt._M_get_fields(),
+			format_args(std::make_format_args(__args...)), &__loc);
+    }
+
+  template<typename _Alloc, typename... _Args>
+    [[nodiscard]]
+    inline basic_string<wchar_t, char_traits<wchar_t>, _Alloc>
+    format(allocator_arg_t, const _Alloc& __a, const locale& __loc,
+	   wformat_string<_Args...> __fmt, _Args&&... __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(__a, __fmt._M_get_fields(),
+			wformat_args(std::make_wformat_args(__args...)), &__loc);
+    }
+
+  /** Format into a string that allocates from `__mr`.
+   *
+   * This is an extension.
+   */
+  template<typename... _Args>
+    [[nodiscard]]
+    inline pmr::string
+    format(pmr::memory_resource* __mr, format_string<_Args...> __fmt,
+	   _Args&&... __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(pmr::polymorphic_allocator<char>(__mr),
+			__fmt._M_get_fields(),
+			format_args(std::make_format_args(__args...)));
+    }
+
+  template<typename... _Args>
+    [[nodiscard]]
+    inline pmr::wstring
+    format(pmr::memory_resource* __mr, wformat_string<_Args...> __fmt,
+	   _Args&&... __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat(pmr::polymorphic_allocator<wchar_t>(__mr),
+			__fmt._M_get_fields(),
+			wformat_args(std::make_wformat_args(__args...)));
     }
 
   template<typename _Out, typename... _Args>
@@ -3770,8 +6481,9 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     inline _Out
     format_to(_Out __out, format_string<_Args...> __fmt, _Args&&... __args)
     {
-      return std::vformat_to(std::move(__out), __fmt.get(),
-			     std::make_format_args(std::forward<_Args>(__args)...));
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	std::move(__out), __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)));
     }
 
   template<typename _Out, typename... _Args>
@@ -3779,8 +6491,117 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     inline _Out
     format_to(_Out __out, wformat_string<_Args...> __fmt, _Args&&... __args)
     {
-      return std::vformat_to(std::move(__out), __fmt.get(),
-			     std::make_wformat_args(std::forward<_Args>(__args)...));
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	std::move(__out), __fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(std::forward<_Args>(__args)...)));
+    }
+
+  // Format into an array. If formatted_size_max shows that the output always
+  // fits, the array is written without checking for the end of the buffer.
+  template<size_t _Nm, typename... _Args>
+    inline char*
+    format_to(char (&__buf)[_Nm], format_string<_Args...> __fmt,
+	      _Args&&... __args)
+    {
+      auto __store = std::make_format_args(std::forward<_Args>(__args)...);
+      const format_args __fmt_args(__store);
+      if (__fmt._M_get_max_size() > _Nm)
+	return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+		 static_cast<char*>(__buf), __fmt._M_get_fields(), __fmt_args);
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Fixed_sink<char> __sink(__buf);
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(__sink.out(),
+					       __fmt._M_get_fields(),
+					       __fmt_args);
+      return __sink._M_finish();
+    }
+
+  template<size_t _Nm, typename... _Args>
+    inline wchar_t*
+    format_to(wchar_t (&__buf)[_Nm], wformat_string<_Args...> __fmt,
+	      _Args&&... __args)
+    {
+      auto __store = std::make_wformat_args(std::forward<_Args>(__args)...);
+      const wformat_args __fmt_args(__store);
+      if (__fmt._M_get_max_size() > _Nm)
+	return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+		 static_cast<wchar_t*>(__buf), __fmt._M_get_fields(), __fmt_args);
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Fixed_sink<wchar_t> __sink(__buf);
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(__sink.out(),
+					       __fmt._M_get_fields(),
+					       __fmt_args);
+      return __sink._M_finish();
+    }
+
+  // Append to a basic_memory_buffer, writing directly into its storage.
+  template<size_t _Nm, typename _Alloc, typename... _Args>
+    inline back_insert_iterator<basic_memory_buffer<char, _Nm, _Alloc>>
+    format_to(basic_memory_buffer<char, _Nm, _Alloc>& __buf,
+	      format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_buffer(
+	__buf, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)));
+      return back_inserter(__buf);
+    }
+
+  template<size_t _Nm, typename _Alloc, typename... _Args>
+    inline back_insert_iterator<basic_memory_buffer<wchar_t, _Nm, _Alloc>>
+    format_to(basic_memory_buffer<wchar_t, _Nm, _Alloc>& __buf,
+	      wformat_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_buffer(
+	__buf, __fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(std::forward<_Args>(__args)...)));
+      return back_inserter(__buf);
+    }
+
+  // Append a record to a basic_format_ring, claiming enough space for the
+  // longest possible output up front when that is known at compile-time.
+  // Returns false if the record was truncated to fit.
+  template<typename... _Args>
+    inline bool
+    format_to(format_ring& __ring, format_string<_Args...> __fmt,
+	      _Args&&... __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_ring(
+	__ring, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)),
+	__fmt._M_get_max_size());
+    }
+
+  template<typename... _Args>
+    inline bool
+    format_to(wformat_ring& __ring, wformat_string<_Args...> __fmt,
+	      _Args&&... __args)
+    {
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_ring(
+	__ring, __fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(std::forward<_Args>(__args)...)),
+	__fmt._M_get_max_size());
+    }
+
+  /** Append formatted output to a string, reusing its existing capacity.
+   *
+   * This is an extension.
+   */
+  template<typename _Traits, typename _Alloc, typename... _Args>
+    inline void
+    format_append(basic_string<char, _Traits, _Alloc>& __str,
+		  format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_append(
+	__str, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)));
+    }
+
+  template<typename _Traits, typename _Alloc, typename... _Args>
+    inline void
+    format_append(basic_string<wchar_t, _Traits, _Alloc>& __str,
+		  wformat_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_append(
+	__str, __fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(std::forward<_Args>(__args)...)));
     }
 
   template<typename _Out, typename... _Args>
@@ -3789,8 +6610,9 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     format_to(_Out __out, const locale& __loc, format_string<_Args...> __fmt,
 	      _Args&&... __args)
     {
-      return std::vformat_to(std::move(__out), __loc, __fmt.get(),
-			     std::make_format_args(std::forward<_Args>(__args)...));
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	std::move(__out), __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)), &__loc);
     }
 
   template<typename _Out, typename... _Args>
@@ -3799,8 +6621,9 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     format_to(_Out __out, const locale& __loc, wformat_string<_Args...> __fmt,
 	      _Args&&... __args)
     {
-      return std::vformat_to(std::move(__out), __loc, __fmt.get(),
-			     std::make_wformat_args(std::forward<_Args>(__args)...));
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	std::move(__out), __fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(std::forward<_Args>(__args)...)), &__loc);
     }
 
   template<typename _Out, typename... _Args>
@@ -3810,8 +6633,9 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 		format_string<_Args...> __fmt, _Args&&... __args)
     {
       CXX20_FORMAT_DECORATE_NAME(__format)::_Iter_sink<char, _Out> __sink(std::move(__out), __n);
-      std::vformat_to(__sink.out(), __fmt.get(),
-		      std::make_format_args(__args...));
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	__sink.out(), __fmt._M_get_fields(),
+	format_args(std::make_format_args(__args...)));
       return std::move(__sink)._M_finish();
     }
 
@@ -3822,8 +6646,9 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 		wformat_string<_Args...> __fmt, _Args&&... __args)
     {
       CXX20_FORMAT_DECORATE_NAME(__format)::_Iter_sink<wchar_t, _Out> __sink(std::move(__out), __n);
-      std::vformat_to(__sink.out(), __fmt.get(),
-		      std::make_wformat_args(__args...));
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	__sink.out(), __fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(__args...)));
       return std::move(__sink)._M_finish();
     }
 
@@ -3834,8 +6659,9 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 		format_string<_Args...> __fmt, _Args&&... __args)
     {
       CXX20_FORMAT_DECORATE_NAME(__format)::_Iter_sink<char, _Out> __sink(std::move(__out), __n);
-      std::vformat_to(__sink.out(), __loc, __fmt.get(),
-		      std::make_format_args(__args...));
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	__sink.out(), __fmt._M_get_fields(),
+	format_args(std::make_format_args(__args...)), &__loc);
       return std::move(__sink)._M_finish();
     }
 
@@ -3846,8 +6672,71 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
 		wformat_string<_Args...> __fmt, _Args&&... __args)
     {
       CXX20_FORMAT_DECORATE_NAME(__format)::_Iter_sink<wchar_t, _Out> __sink(std::move(__out), __n);
-      std::vformat_to(__sink.out(), __loc, __fmt.get(),
-		      std::make_wformat_args(__args...));
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	__sink.out(), __fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(__args...)), &__loc);
+      return std::move(__sink)._M_finish();
+    }
+
+  /** Write at most `__n` characters of formatted output to `__out`.
+   *
+   * Unlike `format_to_n`, this does not compute the size of the complete
+   * output. Formatting stops soon after the output no longer fits, and
+   * the result only says whether it was truncated.
+   *
+   * This is an extension.
+   */
+  template<typename _Out, typename... _Args>
+    requires output_iterator<_Out, const char&>
+    inline format_to_n_truncated_result<_Out>
+    format_to_n_truncated(_Out __out, iter_difference_t<_Out> __n,
+			  format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Truncating_sink<char, _Out> __sink(std::move(__out), __n);
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	__sink.out(), __fmt._M_get_fields(),
+	format_args(std::make_format_args(__args...)));
+      return std::move(__sink)._M_finish();
+    }
+
+  template<typename _Out, typename... _Args>
+    requires output_iterator<_Out, const wchar_t&>
+    inline format_to_n_truncated_result<_Out>
+    format_to_n_truncated(_Out __out, iter_difference_t<_Out> __n,
+			  wformat_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Truncating_sink<wchar_t, _Out> __sink(std::move(__out), __n);
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	__sink.out(), __fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(__args...)));
+      return std::move(__sink)._M_finish();
+    }
+
+  template<typename _Out, typename... _Args>
+    requires output_iterator<_Out, const char&>
+    inline format_to_n_truncated_result<_Out>
+    format_to_n_truncated(_Out __out, iter_difference_t<_Out> __n,
+			  const locale& __loc, format_string<_Args...> __fmt,
+			  _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Truncating_sink<char, _Out> __sink(std::move(__out), __n);
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	__sink.out(), __fmt._M_get_fields(),
+	format_args(std::make_format_args(__args...)), &__loc);
+      return std::move(__sink)._M_finish();
+    }
+
+  template<typename _Out, typename... _Args>
+    requires output_iterator<_Out, const wchar_t&>
+    inline format_to_n_truncated_result<_Out>
+    format_to_n_truncated(_Out __out, iter_difference_t<_Out> __n,
+			  const locale& __loc, wformat_string<_Args...> __fmt,
+			  _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Truncating_sink<wchar_t, _Out> __sink(std::move(__out), __n);
+      CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(
+	__sink.out(), __fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(__args...)), &__loc);
       return std::move(__sink)._M_finish();
     }
 
@@ -3895,18 +6784,62 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
       }
     };
 #endif
+
+  // Compute the length of the output of formatting __args with __fmt,
+  // without formatting the arguments where possible.
+  template<typename _CharT, typename _Context>
+    inline size_t
+    __formatted_size(_Field_span<_CharT> __fmt,
+		     const basic_format_args<_Context>& __args,
+		     const locale* __loc)
+    {
+      _Counting_sink<_CharT> __buf;
+      if (!__fmt._M_fields)
+	{
+	  CXX20_FORMAT_DECORATE_NAME(__format)::__do_vformat_to(__buf.out(), __fmt, __args, __loc);
+	  return __buf.count();
+	}
+      auto __ctx = __loc == nullptr
+		     ? _Context(__args, __buf.out())
+		     : _Context(__args, __buf.out(), *__loc);
+      _Formatting_scanner<_Sink_iter<_CharT>, _CharT> __scanner(__ctx,
+								__fmt._M_str);
+      const size_t __n = __scanner._M_measure(__fmt);
+      return __n + __buf.count();
+    }
 } // namespace __format
 /// @endcond
 
+  /** An upper bound of the length of the output of formatting arguments of
+   * types `_Args...` with the format string `__fmt`.
+   *
+   * Returns `size_t(-1)` if the length is not bounded, e.g. if a string is
+   * formatted without a precision, a width or precision is taken from an
+   * argument, the `L` option is used, or an argument has a formatter that
+   * is not one of the library's own.
+   *
+   * This is an extension.
+   */
+  template<typename... _Args>
+    [[nodiscard]]
+    consteval size_t
+    formatted_size_max(format_string<_Args...> __fmt)
+    { return __fmt._M_get_max_size(); }
+
+  template<typename... _Args>
+    [[nodiscard]]
+    consteval size_t
+    formatted_size_max(wformat_string<_Args...> __fmt)
+    { return __fmt._M_get_max_size(); }
+
   template<typename... _Args>
     [[nodiscard]]
     inline size_t
     formatted_size(format_string<_Args...> __fmt, _Args&&... __args)
     {
-      CXX20_FORMAT_DECORATE_NAME(__format)::_Counting_sink<char> __buf;
-      std::vformat_to(__buf.out(), __fmt.get(),
-		      std::make_format_args(std::forward<_Args>(__args)...));
-      return __buf.count();
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__formatted_size(
+	__fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)));
     }
 
   template<typename... _Args>
@@ -3914,10 +6847,9 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     inline size_t
     formatted_size(wformat_string<_Args...> __fmt, _Args&&... __args)
     {
-      CXX20_FORMAT_DECORATE_NAME(__format)::_Counting_sink<wchar_t> __buf;
-      std::vformat_to(__buf.out(), __fmt.get(),
-		      std::make_wformat_args(std::forward<_Args>(__args)...));
-      return __buf.count();
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__formatted_size(
+	__fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(std::forward<_Args>(__args)...)));
     }
 
   template<typename... _Args>
@@ -3926,10 +6858,9 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     formatted_size(const locale& __loc, format_string<_Args...> __fmt,
 		   _Args&&... __args)
     {
-      CXX20_FORMAT_DECORATE_NAME(__format)::_Counting_sink<char> __buf;
-      std::vformat_to(__buf.out(), __loc, __fmt.get(),
-		      std::make_format_args(std::forward<_Args>(__args)...));
-      return __buf.count();
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__formatted_size(
+	__fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)), &__loc);
     }
 
   template<typename... _Args>
@@ -3938,10 +6869,287 @@ namespace CXX20_FORMAT_DECORATE_NAME(__format)
     formatted_size(const locale& __loc, wformat_string<_Args...> __fmt,
 		   _Args&&... __args)
     {
-      CXX20_FORMAT_DECORATE_NAME(__format)::_Counting_sink<wchar_t> __buf;
-      std::vformat_to(__buf.out(), __loc, __fmt.get(),
-		      std::make_wformat_args(std::forward<_Args>(__args)...));
-      return __buf.count();
+      return CXX20_FORMAT_DECORATE_NAME(__format)::__formatted_size(
+	__fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(std::forward<_Args>(__args)...)), &__loc);
+    }
+
+/// @cond undocumented
+namespace CXX20_FORMAT_DECORATE_NAME(__format)
+{
+  // Format to a C stream while holding its lock, or to a file descriptor,
+  // followed by a newline if __newline is true. These are defined in the
+  // library.
+  void
+  __vprint(FILE* __stream, _Field_span<char> __fmt, const format_args& __args,
+	   bool __newline);
+
+  void
+  __vprint(int __fd, _Field_span<char> __fmt, const format_args& __args,
+	   bool __newline);
+} // namespace __format
+/// @endcond
+
+  // [print.fun], print functions
+  // These are C++23 features, available as an extension in C++20.
+  // The output is buffered and written with a single lock of the stream,
+  // without creating a string first.
+
+  inline void
+  vprint_unicode(FILE* __stream, string_view __fmt, format_args __args)
+  {
+    CXX20_FORMAT_DECORATE_NAME(__format)::__vprint(__stream,
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args, false);
+  }
+
+  inline void
+  vprint_nonunicode(FILE* __stream, string_view __fmt, format_args __args)
+  {
+    CXX20_FORMAT_DECORATE_NAME(__format)::__vprint(__stream,
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args, false);
+  }
+
+  template<typename... _Args>
+    inline void
+    print(FILE* __stream, format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vprint(__stream, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)),
+	false);
+    }
+
+  template<typename... _Args>
+    inline void
+    print(format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vprint(stdout, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)),
+	false);
+    }
+
+  template<typename... _Args>
+    inline void
+    println(FILE* __stream, format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vprint(__stream, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)),
+	true);
+    }
+
+  template<typename... _Args>
+    inline void
+    println(format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vprint(stdout, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)),
+	true);
+    }
+
+  // Write to a file descriptor with write(2). This is an extension.
+
+  inline void
+  vprint_nonunicode(int __fd, string_view __fmt, format_args __args)
+  {
+    CXX20_FORMAT_DECORATE_NAME(__format)::__vprint(__fd,
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args, false);
+  }
+
+  template<typename... _Args>
+    inline void
+    print(int __fd, format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vprint(__fd, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)),
+	false);
+    }
+
+  template<typename... _Args>
+    inline void
+    println(int __fd, format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vprint(__fd, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)),
+	true);
+    }
+
+/// @cond undocumented
+namespace CXX20_FORMAT_DECORATE_NAME(__format)
+{
+  // A sink that writes to a stream buffer. The unused part of the put area
+  // is used as the span whenever there is one, so output is written into the
+  // stream buffer directly. Otherwise output is collected in the internal
+  // buffer and passed to sputn, which lets the stream buffer make room.
+  template<typename _CharT, typename _Traits>
+    class _Streambuf_sink final : public _Buf_sink<_CharT>
+    {
+      using __streambuf_type = basic_streambuf<_CharT, _Traits>;
+
+      // Access to the protected members that manage the put area.
+      struct _Access : __streambuf_type
+      {
+	static _CharT*
+	_S_pptr(__streambuf_type& __sb)
+	{ return (__sb.*&_Access::pptr)(); }
+
+	static _CharT*
+	_S_epptr(__streambuf_type& __sb)
+	{ return (__sb.*&_Access::epptr)(); }
+
+	static void
+	_S_pbump(__streambuf_type& __sb, size_t __n)
+	{
+	  constexpr size_t __max = __gnu_cxx::__int_traits<int>::__max;
+	  for (; __n > __max; __n -= __max)
+	    (__sb.*&_Access::pbump)(__max);
+	  (__sb.*&_Access::pbump)(__n);
+	}
+      };
+
+      __streambuf_type* _M_sb;
+      bool _M_in_put_area = false;
+      bool _M_failed = false;
+
+      // Write to the put area if it has space, otherwise to the buffer.
+      void
+      _M_use_put_area() noexcept
+      {
+	span<_CharT> __s(this->_M_buf);
+	_M_in_put_area = false;
+	if (!_M_failed)
+	  if (_CharT* __p = _Access::_S_pptr(*_M_sb))
+	    if (_CharT* __e = _Access::_S_epptr(*_M_sb); __p != __e)
+	      {
+		__s = span<_CharT>(__p, __e);
+		_M_in_put_area = true;
+	      }
+	this->_M_reset(__s, __s.begin());
+      }
+
+      void
+      _M_overflow() override
+      {
+	auto __s = this->_M_used();
+	if (_M_failed)
+	  ;
+	else if (_M_in_put_area)
+	  _Access::_S_pbump(*_M_sb, __s.size());
+	else
+	  __try
+	    {
+	      if (_M_sb->sputn(__s.data(), __s.size()) != streamsize(__s.size()))
+		_M_failed = true;
+	    }
+	  __catch(const __cxxabiv1::__forced_unwind&)
+	    {
+	      _M_failed = true;
+	      __throw_exception_again;
+	    }
+	  __catch(...)
+	    { _M_failed = true; }
+	_M_use_put_area();
+      }
+
+    public:
+      explicit
+      _Streambuf_sink(__streambuf_type* __sb) noexcept
+      : _M_sb(__sb)
+      { _M_use_put_area(); }
+
+      using _Sink<_CharT>::out;
+
+      // Write any buffered output and commit the output in the put area.
+      // Returns false if the stream buffer failed to accept all output.
+      bool
+      _M_finish()
+      {
+	_Streambuf_sink::_M_overflow();
+	return !_M_failed;
+      }
+    };
+
+  // Format to an output stream, using the stream's locale, followed by a
+  // newline if __newline is true. Unlike operator<<, the output is written
+  // as it is formatted, so an exception thrown by a formatter can leave part
+  // of the output in the stream.
+  template<typename _CharT, typename _Traits>
+    void
+    __vformat_to_ostream(basic_ostream<_CharT, _Traits>& __os,
+			 _Field_span<_CharT> __fmt,
+			 const basic_format_args<basic_format_context<_Sink_iter<_CharT>, _CharT>>& __args,
+			 bool __newline)
+    {
+      typename basic_ostream<_CharT, _Traits>::sentry __cerb(__os);
+      if (__cerb)
+	{
+	  const locale __loc = __os.getloc();
+	  _Streambuf_sink<_CharT, _Traits> __sink(__os.rdbuf());
+	  auto __out = __do_vformat_to(__sink.out(), __fmt, __args, &__loc);
+	  if (__newline)
+	    *__out = _CharT('\n');
+	  if (!__sink._M_finish())
+	    __os.setstate(ios_base::badbit);
+	}
+    }
+} // namespace __format
+/// @endcond
+
+  // Format to an output stream without creating a string first.
+  // This is an extension.
+  template<typename _Traits, typename... _Args>
+    inline basic_ostream<char, _Traits>&
+    format_to(basic_ostream<char, _Traits>& __os,
+	      format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_ostream(__os, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)),
+	false);
+      return __os;
+    }
+
+  template<typename _Traits, typename... _Args>
+    inline basic_ostream<wchar_t, _Traits>&
+    format_to(basic_ostream<wchar_t, _Traits>& __os,
+	      wformat_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_ostream(__os, __fmt._M_get_fields(),
+	wformat_args(std::make_wformat_args(std::forward<_Args>(__args)...)),
+	false);
+      return __os;
+    }
+
+  // [ostream.formatted.print], print functions
+  // These are C++23 features, available as an extension in C++20.
+
+  inline void
+  vprint_unicode(ostream& __os, string_view __fmt, format_args __args)
+  {
+    CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_ostream(__os,
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args, false);
+  }
+
+  inline void
+  vprint_nonunicode(ostream& __os, string_view __fmt, format_args __args)
+  {
+    CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_ostream(__os,
+      CXX20_FORMAT_DECORATE_NAME(__format)::_Field_span<char>{__fmt}, __args, false);
+  }
+
+  template<typename... _Args>
+    inline void
+    print(ostream& __os, format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_ostream(__os, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)),
+	false);
+    }
+
+  template<typename... _Args>
+    inline void
+    println(ostream& __os, format_string<_Args...> __fmt, _Args&&... __args)
+    {
+      CXX20_FORMAT_DECORATE_NAME(__format)::__vformat_to_ostream(__os, __fmt._M_get_fields(),
+	format_args(std::make_format_args(std::forward<_Args>(__args)...)),
+	true);
     }
 
 #if __cpp_lib_format_ranges
@@ -0,0 +1,186 @@
+// Definitions for <format> -*- C++ -*-
+
+// Copyright (C) embedded ocean GmbH, Munich, Germany.
+//
+// This file is part of the C++20 Format Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#include <c++20-format.h>
+
+#if defined __x86_64__ || defined __i386__
+# include <immintrin.h>
+# define CXX20_FORMAT_HAVE_X86_SIMD 1
+#endif
+
+namespace
+{
+  template<typename _CharT>
+    const _CharT*
+    __find_brace_scalar(const _CharT* __first, const _CharT* __last) noexcept
+    {
+      for (; __first != __last; ++__first)
+	if (*__first == '{' || *__first == '}')
+	  break;
+      return __first;
+    }
+
+#ifdef CXX20_FORMAT_HAVE_X86_SIMD
+  // The index of the first character whose bit is set in a mask returned by
+  // _mm_movemask_epi8 or _mm256_movemask_epi8.
+  template<typename _CharT>
+    inline unsigned
+    __first_char_in_mask(unsigned __mask) noexcept
+    { return __builtin_ctz(__mask) / sizeof(_CharT); }
+
+  // Compare 16 bytes at a time against both braces.
+  template<typename _CharT>
+    [[__gnu__::__target__("sse2")]]
+    const _CharT*
+    __find_brace_sse2(const _CharT* __first, const _CharT* __last) noexcept
+    {
+      constexpr ptrdiff_t __n = 16 / sizeof(_CharT);
+      __m128i __lbr, __rbr;
+      if constexpr (sizeof(_CharT) == 1)
+	__lbr = _mm_set1_epi8('{'), __rbr = _mm_set1_epi8('}');
+      else if constexpr (sizeof(_CharT) == 2)
+	__lbr = _mm_set1_epi16('{'), __rbr = _mm_set1_epi16('}');
+      else
+	__lbr = _mm_set1_epi32('{'), __rbr = _mm_set1_epi32('}');
+
+      for (; __last - __first >= __n; __first += __n)
+	{
+	  const __m128i __v
+	    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(__first));
+	  __m128i __eq;
+	  if constexpr (sizeof(_CharT) == 1)
+	    __eq = _mm_or_si128(_mm_cmpeq_epi8(__v, __lbr),
+				_mm_cmpeq_epi8(__v, __rbr));
+	  else if constexpr (sizeof(_CharT) == 2)
+	    __eq = _mm_or_si128(_mm_cmpeq_epi16(__v, __lbr),
+				_mm_cmpeq_epi16(__v, __rbr));
+	  else
+	    __eq = _mm_or_si128(_mm_cmpeq_epi32(__v, __lbr),
+				_mm_cmpeq_epi32(__v, __rbr));
+	  if (unsigned __mask = _mm_movemask_epi8(__eq))
+	    return __first + __first_char_in_mask<_CharT>(__mask);
+	}
+      return __find_brace_scalar(__first, __last);
+    }
+
+  // Compare 32 bytes at a time against both braces.
+  template<typename _CharT>
+    [[__gnu__::__target__("avx2")]]
+    const _CharT*
+    __find_brace_avx2(const _CharT* __first, const _CharT* __last) noexcept
+    {
+      constexpr ptrdiff_t __n = 32 / sizeof(_CharT);
+      __m256i __lbr, __rbr;
+      if constexpr (sizeof(_CharT) == 1)
+	__lbr = _mm256_set1_epi8('{'), __rbr = _mm256_set1_epi8('}');
+      else if constexpr (sizeof(_CharT) == 2)
+	__lbr = _mm256_set1_epi16('{'), __rbr = _mm256_set1_epi16('}');
+      else
+	__lbr = _mm256_set1_epi32('{'), __rbr = _mm256_set1_epi32('}');
+
+      for (; __last - __first >= __n; __first += __n)
+	{
+	  const __m256i __v
+	    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(__first));
+	  __m256i __eq;
+	  if constexpr (sizeof(_CharT) == 1)
+	    __eq = _mm256_or_si256(_mm256_cmpeq_epi8(__v, __lbr),
+				   _mm256_cmpeq_epi8(__v, __rbr));
+	  else if constexpr (sizeof(_CharT) == 2)
+	    __eq = _mm256_or_si256(_mm256_cmpeq_epi16(__v, __lbr),
+				   _mm256_cmpeq_epi16(__v, __rbr));
+	  else
+	    __eq = _mm256_or_si256(_mm256_cmpeq_epi32(__v, __lbr),
+				   _mm256_cmpeq_epi32(__v, __rbr));
+	  if (unsigned __mask = _mm256_movemask_epi8(__eq))
+	    return __first + __first_char_in_mask<_CharT>(__mask);
+	}
+      // Finish with at most one 16-byte block and then scalar code.
+      return __find_brace_sse2(__first, __last);
+    }
+#endif // CXX20_FORMAT_HAVE_X86_SIMD
+
+  template<typename _CharT>
+    using __find_brace_fn = const _CharT* (*)(const _CharT*,
+					       const _CharT*) noexcept;
+
+  // Choose the best implementation for the CPU we are running on.
+  template<typename _CharT>
+    __find_brace_fn<_CharT>
+    __select_find_brace() noexcept
+    {
+#ifdef CXX20_FORMAT_HAVE_X86_SIMD
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+	return &__find_brace_avx2<_CharT>;
+      if (__builtin_cpu_supports("sse2"))
+	return &__find_brace_sse2<_CharT>;
+#endif
+      return &__find_brace_scalar<_CharT>;
+    }
+
+  template<typename _CharT>
+    const _CharT*
+    __find_brace_init(const _CharT*, const _CharT*) noexcept;
+
+  // The implementation in use. This starts out as __find_brace_init, which
+  // replaces it on first use, so that no static initialization is needed.
+  template<typename _CharT>
+    __find_brace_fn<_CharT> __find_brace_impl = &__find_brace_init<_CharT>;
+
+  template<typename _CharT>
+    const _CharT*
+    __find_brace_init(const _CharT* __first, const _CharT* __last) noexcept
+    {
+      const auto __fn = __select_find_brace<_CharT>();
+      __atomic_store_n(&__find_brace_impl<_CharT>, __fn, __ATOMIC_RELAXED);
+      return __fn(__first, __last);
+    }
+
+  template<typename _CharT>
+    inline const _CharT*
+    __find_brace_dispatch(const _CharT* __first, const _CharT* __last) noexcept
+    {
+      const auto __fn
+	= __atomic_load_n(&__find_brace_impl<_CharT>, __ATOMIC_RELAXED);
+      return __fn(__first, __last);
+    }
+} // namespace
+
+namespace std CXX20_FORMAT_VISIBILITY_ATTRIBUTE
+{
+inline namespace CXX20_FORMAT_NAMESPACE
+{
+namespace CXX20_FORMAT_DECORATE_NAME(__format)
+{
+  const char*
+  __find_brace_simd(const char* __first, const char* __last) noexcept
+  { return __find_brace_dispatch(__first, __last); }
+
+  const wchar_t*
+  __find_brace_simd(const wchar_t* __first, const wchar_t* __last) noexcept
+  { return __find_brace_dispatch(__first, __last); }
+} // namespace __format
+} // namespace CXX20_FORMAT_NAMESPACE
+} // namespace std
@@ -0,0 +1,186 @@
+// Print functions -*- C++ -*-
+
+// Copyright (C) embedded ocean GmbH, Munich, Germany.
+//
+// This file is part of the C++20 Format Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include <c++20-format.h>
+#include <cerrno>
+#include <system_error>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace std CXX20_FORMAT_VISIBILITY_ATTRIBUTE
+{
+inline namespace CXX20_FORMAT_NAMESPACE
+{
+namespace CXX20_FORMAT_DECORATE_NAME(__format)
+{
+namespace
+{
+  // Write all of __str to a stream that the caller has locked.
+  void
+  __write_all(FILE* __stream, span<char> __str)
+  {
+    if (::fwrite_unlocked(__str.data(), 1, __str.size(), __stream)
+	  != __str.size())
+      __throw_system_error(EIO);
+  }
+
+  // A sink that writes to a stream whenever its buffer fills up.
+  class _File_sink final : public _Sink<char>
+  {
+    FILE* _M_stream;
+    char _M_buf[4096];
+
+    void
+    _M_overflow() override
+    {
+      __write_all(_M_stream, _M_used());
+      _M_rewind();
+    }
+
+  public:
+    explicit
+    _File_sink(FILE* __stream) noexcept
+    : _Sink<char>(_M_buf), _M_stream(__stream)
+    { }
+
+    void
+    _M_finish()
+    { _File_sink::_M_overflow(); }
+  };
+
+  // A sink that writes to a file descriptor with writev. Output is copied
+  // into the buffer, except for strings of at least _S_min_ref characters
+  // that do not fit into it. Those are written from where they are, in the
+  // same writev call as the buffered output before them. They cannot be
+  // kept for a later call, because formatters write temporary strings too.
+  class _Iovec_sink final : public _Sink<char>
+  {
+    static constexpr size_t _S_min_ref = 512;
+
+    int _M_fd;
+    int _M_niov = 0;
+    char* _M_start = _M_buf; // The start of the output not yet in _M_iov.
+    iovec _M_iov[2];
+    char _M_buf[4096];
+
+    // Add the output in the buffer since the last piece to the list.
+    void
+    _M_add_buffered() noexcept
+    {
+      auto __s = _M_used();
+      char* __end = __s.data() + __s.size();
+      if (__end != _M_start)
+	{
+	  _M_iov[_M_niov++] = { _M_start, size_t(__end - _M_start) };
+	  _M_start = __end;
+	}
+    }
+
+    void
+    _M_flush()
+    {
+      _M_add_buffered();
+      iovec* __iov = _M_iov;
+      int __n = _M_niov;
+      while (__n > 0)
+	{
+	  ssize_t __written = ::writev(_M_fd, __iov, __n);
+	  if (__written < 0)
+	    {
+	      if (errno == EINTR)
+		continue;
+	      __throw_system_error(errno);
+	    }
+	  for (; __n > 0 && size_t(__written) >= __iov->iov_len; ++__iov, --__n)
+	    __written -= __iov->iov_len;
+	  if (__n > 0)
+	    {
+	      __iov->iov_base = static_cast<char*>(__iov->iov_base) + __written;
+	      __iov->iov_len -= __written;
+	    }
+	}
+      _M_niov = 0;
+      _M_rewind();
+      _M_start = _M_buf;
+    }
+
+    void
+    _M_overflow() override
+    { _M_flush(); }
+
+    void
+    _M_write_overflowing(string_view __s) override
+    {
+      if (__s.size() < _S_min_ref)
+	return _Sink<char>::_M_write_overflowing(__s);
+      _M_add_buffered();
+      _M_iov[_M_niov++] = { const_cast<char*>(__s.data()), __s.size() };
+      _M_flush();
+    }
+
+  public:
+    explicit
+    _Iovec_sink(int __fd) noexcept
+    : _Sink<char>(_M_buf), _M_fd(__fd)
+    { }
+
+    void
+    _M_finish()
+    { _M_flush(); }
+  };
+
+  template<typename _Sink_type, typename _File>
+    void
+    __vprint_to(_File __file, _Field_span<char> __fmt,
+		const format_args& __args, bool __newline)
+    {
+      _Sink_type __sink(__file);
+      auto __out = __do_vformat_to(__sink.out(), __fmt, __args);
+      if (__newline)
+	*__out = '\n';
+      __sink._M_finish();
+    }
+} // namespace
+
+  void
+  __vprint(FILE* __stream, _Field_span<char> __fmt, const format_args& __args,
+	   bool __newline)
+  {
+    ::flockfile(__stream);
+    struct _Unlock
+    {
+      FILE* _M_stream;
+      ~_Unlock() { ::funlockfile(_M_stream); }
+    } __unlock{__stream};
+    __vprint_to<_File_sink>(__stream, __fmt, __args, __newline);
+  }
+
+  void
+  __vprint(int __fd, _Field_span<char> __fmt, const format_args& __args,
+	   bool __newline)
+  { __vprint_to<_Iovec_sink>(__fd, __fmt, __args, __newline); }
+} // namespace __format
+} // namespace CXX20_FORMAT_NAMESPACE
+} // namespace std
@@ -1,14 +1,125 @@
 #include <c++20-format.h>
 
+#include <algorithm>
+#include <memory_resource>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <iostream>
 
 using namespace std::literals;
 
+struct Failing
+{
+};
+
+struct Reserved
+{
+	std::string_view text;
+};
+
+template<>
+struct std::formatter<Reserved>
+{
+	constexpr auto parse(std::format_parse_context &context) -> std::format_parse_context::iterator
+	{
+		return context.begin();
+	}
+
+	auto format(Reserved value, std::format_context &context) const -> std::format_context::iterator
+	{
+		std::format_reservation reservation(context, value.text.size() + 2);
+		char *data = reservation.data();
+		*data++ = '<';
+		data = std::copy(value.text.begin(), value.text.end(), data);
+		*data++ = '>';
+		reservation.commit(data - reservation.data());
+		return context.out();
+	}
+};
+
+struct Counted
+{
+	static inline int calls = 0;
+};
+
+template<>
+struct std::formatter<Counted> : std::formatter<std::string_view>
+{
+	auto format(Counted, std::format_context &context) const -> std::format_context::iterator
+	{
+		++Counted::calls;
+		return std::formatter<std::string_view>::format("field", context);
+	}
+};
+
+template<>
+struct std::formatter<Failing> : std::formatter<std::string_view>
+{
+	auto format(Failing, std::format_context &) const -> std::format_context::iterator
+	{
+		throw std::runtime_error("formatter failed");
+	}
+};
+
 int main()
 {
 	std::cout << std::format("{}\n{}\n{}\n{}\n{}\n{}\n{}\n", -122, 342u, "const char[]", "std::string"s, "std::string_view"sv, 12.4, 8.3f) << std::flush;
 
+	int count = 3;
+	double ratio = 0.25;
+	auto compiled = std::make_compiled_format<int, double>("{:>4}|{:.2f}\n");
+	std::cout << std::vformat(compiled, std::make_format_args(count, ratio)) << std::flush;
+	try
+	{
+		std::cout << std::vformat(compiled, std::make_format_args(ratio, count)) << std::flush;
+	}
+	catch (const std::format_error &)
+	{
+		std::cout << "mismatched arguments rejected\n" << std::flush;
+	}
+
+	char record[std::formatted_size_max<int, double>("{:>4}|{:.2f}\n")];
+	std::cout << std::string_view(record, std::format_to(record, "{:>4}|{:.2f}\n", count, ratio)) << std::flush;
+
+	std::cout << std::format("{user} logged in from {ip}\n", std::arg<"user">("alice"sv), std::arg<"ip">("10.0.0.1")) << std::flush;
+
+	std::memory_buffer buffer;
+	std::format_to(buffer, "{}|", count);
+	std::string line(buffer.data(), buffer.size());
+	std::format_append(line, "{}\n", ratio);
+	std::cout << line << std::flush;
+	try
+	{
+		std::format_append(line, "{}", Failing());
+	}
+	catch (const std::runtime_error &)
+	{
+		std::cout << line << std::flush;
+	}
+
+	std::println("{} of {} done", count, count);
+	std::println(std::cout, "{} of {} written", count, count);
+
+	std::format_ring ring(1024);
+	std::format_to(ring, "{} records queued\n", count);
+	ring.consume([](std::string_view record) { std::cout << record; });
+
+	char prefix[8];
+	auto truncated = std::format_to_n_truncated(prefix, sizeof(prefix), "{} of {} truncated", count, count);
+	std::cout << std::string_view(prefix, truncated.out) << (truncated.truncated ? "...\n" : "\n") << std::flush;
+
+	Counted field;
+	auto stopped = std::format_to_n_truncated(prefix, 4, "{}{}{}{}{}{}{}{}", field, field, field, field, field, field, field, field);
+	std::cout << std::string_view(prefix, stopped.out) << "... after " << Counted::calls << " of 8 fields\n" << std::flush;
+
+	char arena[256];
+	std::pmr::monotonic_buffer_resource resource(arena, sizeof(arena));
+	std::cout << std::format(&resource, "{:.1f} in the arena\n", ratio) << std::flush;
+
+	std::cout << std::format("{:,} bytes in {:_.1f} ms\n", 1234567, 98765.4) << std::flush;
+
+	std::cout << std::format("{} written in place\n", Reserved{"record"}) << std::flush;
+
 	return 0;
 }